@@ -0,0 +1,454 @@
+/****************************************************************************************/
+/* SUNXI library micro-benchmarks                                                       */
+/****************************************************************************************/
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "hw.h"
+#include "gpio.h"
+#include "lock.h"
+#include "lradc.h"
+#include "pwm.h"
+#include "sim.h"
+#include "spi.h"
+#include "spi_display.h"
+#include "spi_flash.h"
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* Default number of samples and warm-up samples per benchmark */
+#define SUNXI_BENCH_SAMPLES                     10000
+#define SUNXI_BENCH_WARMUP                      1000
+
+/* Number of operations timed per sample for the short operations */
+#define SUNXI_BENCH_BATCH                       64
+
+/* Maximum number of threads of the contention benchmark */
+#define SUNXI_BENCH_THREADS_MAX                 32
+
+/* Run a benchmark, the statement is inlined in the timed loop (i is the operation index) */
+#define SUNXI_BENCH(name, batch, stmt) do {                                                 \
+    unsigned int sample, i;                                                                 \
+    unsigned long long start;                                                               \
+    for (sample = 0; sample < sunxi_bench.warmup + sunxi_bench.samples; sample++) {         \
+      start = sunxi_bench_now();                                                            \
+      for (i = 0; i < (batch); i++) {                                                       \
+        stmt;                                                                               \
+      }                                                                                     \
+      if (sample >= sunxi_bench.warmup)                                                     \
+        sunxi_bench.times[sample - sunxi_bench.warmup] = (sunxi_bench_now() - start) / (double)(batch); \
+    }                                                                                       \
+    sunxi_bench_report(name, 0);                                                            \
+  } while (0)
+
+/* SUNXI benchmark settings and samples */
+struct sunxi_bench {
+  unsigned int samples;
+  unsigned int warmup;
+  int cpu;
+  int hw;
+  int json;
+  int rt;
+  unsigned int pin;
+  unsigned int threads;
+  char *spi;
+  double *times;
+};
+
+/* SUNXI contention benchmark thread */
+struct sunxi_bench_thread {
+  pthread_t thread;
+  pthread_barrier_t *barrier;
+  unsigned int pin;
+  unsigned int lost;
+  double *times;
+};
+
+
+/****************************************************************************************/
+/* Global variables                                                                     */
+/****************************************************************************************/
+
+/* SUNXI benchmark */
+static struct sunxi_bench sunxi_bench = {
+  .samples = SUNXI_BENCH_SAMPLES,
+  .warmup = SUNXI_BENCH_WARMUP,
+  .cpu = -1,
+  .pin = SUNXI_GPIO_PIN_PA0,
+  .threads = 4
+};
+
+/* Value sink, prevents the compiler from removing the benchmarked reads */
+static volatile unsigned int sunxi_bench_sink;
+
+
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Get current time
+ * @return Current time in ns
+ */
+static unsigned long long sunxi_bench_now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Compare samples, used to sort them
+ */
+static int sunxi_bench_compare(const void *a, const void *b) {
+
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+/**
+ * Report benchmark statistics computed from the samples
+ * @param name Benchmark name
+ * @param lost Number of lost updates, contention benchmark only
+ */
+static void sunxi_bench_report(char *name, unsigned int lost) {
+
+  unsigned int index, count = sunxi_bench.samples;
+  double mean = 0, p50, p99, max;
+
+  qsort(sunxi_bench.times, count, sizeof(double), sunxi_bench_compare);
+  for (index = 0; index < count; index++) {
+    mean += sunxi_bench.times[index];
+  }
+  mean /= count;
+  p50 = sunxi_bench.times[count / 2];
+  p99 = sunxi_bench.times[(count * 99) / 100];
+  max = sunxi_bench.times[count - 1];
+
+  if (sunxi_bench.json) {
+    printf("{\"name\":\"%s\",\"samples\":%u,\"ns_mean\":%.2f,\"ns_p50\":%.2f,\"ns_p99\":%.2f,\"ns_max\":%.2f,\"ops_per_s\":%.0f,\"lost\":%u}\n",
+           name, count, mean, p50, p99, max, (mean > 0) ? 1e9 / mean : 0, lost);
+  } else {
+    printf("%-28s %10.1f %10.1f %10.1f %10.1f %14.0f", name, mean, p50, p99, max, (mean > 0) ? 1e9 / mean : 0);
+    if (lost != 0) printf("   lost=%u", lost);
+    printf("\n");
+  }
+  fflush(stdout);
+}
+
+/**
+ * Contention benchmark thread, toggles its own pin and checks the written value is read back
+ * @param arg Thread context
+ * @return Always NULL
+ */
+static void *sunxi_bench_thread(void *arg) {
+
+  struct sunxi_bench_thread *thread = (struct sunxi_bench_thread *)arg;
+  unsigned long long start;
+  unsigned int sample, index;
+
+  /* Start all the threads together */
+  pthread_barrier_wait(thread->barrier);
+
+  for (sample = 0; sample < sunxi_bench.samples; sample++) {
+    start = sunxi_bench_now();
+    for (index = 0; index < SUNXI_BENCH_BATCH; index++) {
+      sunxi_gpio_output(thread->pin, 1);
+      if (sunxi_gpio_input(thread->pin) != 1) thread->lost++;
+      sunxi_gpio_output(thread->pin, 0);
+      if (sunxi_gpio_input(thread->pin) != 0) thread->lost++;
+    }
+    if (thread->times != NULL)
+      thread->times[sample] = (sunxi_bench_now() - start) / (double)(SUNXI_BENCH_BATCH * 2);
+  }
+
+  return NULL;
+}
+
+/**
+ * Contention benchmark, several threads toggle pins of the same bank, the output timings of the first thread are reported
+ * @param name Benchmark name
+ * @param lock_mode Lock mode used during the benchmark
+ */
+static void sunxi_bench_contention(char *name, unsigned int lock_mode) {
+
+  struct sunxi_bench_thread threads[SUNXI_BENCH_THREADS_MAX];
+  pthread_barrier_t barrier;
+  unsigned int index, lost = 0;
+
+  sunxi_lock_set_mode(lock_mode);
+  for (index = 0; index < sunxi_bench.threads; index++) {
+    sunxi_gpio_set_cfgpin(sunxi_bench.pin + index, SUNXI_GPIO_OUTPUT);
+  }
+  pthread_barrier_init(&barrier, NULL, sunxi_bench.threads);
+  for (index = 0; index < sunxi_bench.threads; index++) {
+    threads[index].barrier = &barrier;
+    threads[index].pin = sunxi_bench.pin + index;
+    threads[index].lost = 0;
+    threads[index].times = (index == 0) ? sunxi_bench.times : NULL;
+    pthread_create(&threads[index].thread, NULL, sunxi_bench_thread, &threads[index]);
+  }
+  for (index = 0; index < sunxi_bench.threads; index++) {
+    pthread_join(threads[index].thread, NULL);
+    lost += threads[index].lost;
+  }
+  pthread_barrier_destroy(&barrier);
+  sunxi_lock_set_mode(SUNXI_LOCK_MODE_NONE);
+  sunxi_bench_report(name, lost);
+}
+
+/**
+ * Print usage
+ * @param prog Program name
+ */
+static void sunxi_bench_usage(char *prog) {
+
+  printf("Usage: %s [options]\n", prog);
+  printf("  -s, --samples N   number of samples per benchmark (default %u)\n", SUNXI_BENCH_SAMPLES);
+  printf("  -w, --warmup N    number of warm-up samples per benchmark (default %u)\n", SUNXI_BENCH_WARMUP);
+  printf("  -c, --cpu N       pin the benchmark to CPU N\n");
+  printf("  -r, --rt          run with SCHED_FIFO real-time priority\n");
+  printf("  -H, --hw          use the hardware registers instead of the simulator\n");
+  printf("  -p, --pin N       first GPIO pin used by the benchmarks (default PA0, 8 pins are used)\n");
+  printf("  -t, --threads N   number of threads of the contention benchmark (default 4)\n");
+  printf("  -S, --spi PATH    use spidev device PATH instead of the simulated spidev\n");
+  printf("  -j, --json        machine-readable output, one JSON object per line\n");
+}
+
+
+/****************************************************************************************/
+/* Main                                                                                 */
+/****************************************************************************************/
+
+int main(int argc, char **argv) {
+
+  static struct option options[] = {
+    { "samples", required_argument, NULL, 's' },
+    { "warmup", required_argument, NULL, 'w' },
+    { "cpu", required_argument, NULL, 'c' },
+    { "rt", no_argument, NULL, 'r' },
+    { "hw", no_argument, NULL, 'H' },
+    { "pin", required_argument, NULL, 'p' },
+    { "threads", required_argument, NULL, 't' },
+    { "spi", required_argument, NULL, 'S' },
+    { "json", no_argument, NULL, 'j' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  struct sched_param param;
+  cpu_set_t cpuset;
+  volatile unsigned int *regs;
+  struct spi_ioc_transfer transfers[3];
+  struct sunxi_spi_message message;
+  static struct sunxi_spi_queue queue;
+  struct sunxi_spi_device device;
+  struct sunxi_spi_pool pool;
+  struct sunxi_pwm_config pwm_config;
+  struct sunxi_pwm_servo servo;
+  struct sunxi_spi_flash flash;
+  struct sunxi_spi_display display;
+  unsigned char *buffer;
+  static unsigned char tx[4096], rx[4096], frame[320 * 240 * 2];
+  unsigned int pin, bank, val;
+  int opt, r, fd, failed = 0;
+
+  /* Parse options */
+  while ((opt = getopt_long(argc, argv, "s:w:c:rHp:t:S:jh", options, NULL)) != -1) {
+    switch (opt) {
+      case 's': sunxi_bench.samples = strtoul(optarg, NULL, 0); break;
+      case 'w': sunxi_bench.warmup = strtoul(optarg, NULL, 0); break;
+      case 'c': sunxi_bench.cpu = atoi(optarg); break;
+      case 'r': sunxi_bench.rt = 1; break;
+      case 'H': sunxi_bench.hw = 1; break;
+      case 'p': sunxi_bench.pin = strtoul(optarg, NULL, 0); break;
+      case 't': sunxi_bench.threads = strtoul(optarg, NULL, 0); break;
+      case 'S': sunxi_bench.spi = optarg; break;
+      case 'j': sunxi_bench.json = 1; break;
+      default: sunxi_bench_usage(argv[0]); return (opt == 'h') ? 0 : 1;
+    }
+  }
+  if ((sunxi_bench.samples == 0) || (sunxi_bench.threads == 0) || (sunxi_bench.threads > SUNXI_BENCH_THREADS_MAX)
+      || ((sunxi_bench.pin & 0x1F) + ((sunxi_bench.threads > 8) ? sunxi_bench.threads : 8) > 32)) {
+    fprintf(stderr, "Invalid options\n");
+    return 1;
+  }
+  if ((sunxi_bench.times = malloc(sunxi_bench.samples * sizeof(double))) == NULL) {
+    fprintf(stderr, "Unable to allocate samples\n");
+    return 1;
+  }
+
+  /* Pin CPU and set real-time priority */
+  if (sunxi_bench.cpu >= 0) {
+    CPU_ZERO(&cpuset);
+    CPU_SET(sunxi_bench.cpu, &cpuset);
+    if (sched_setaffinity(0, sizeof(cpuset), &cpuset) < 0) {
+      perror("sched_setaffinity");
+      return 1;
+    }
+  }
+  if (sunxi_bench.rt) {
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+      perror("sched_setscheduler");
+      return 1;
+    }
+  }
+
+  /* Initialize interfaces */
+  if (!sunxi_bench.hw && ((r = sunxi_sim_init(1000)) < 0)) {
+    fprintf(stderr, "Unable to initialize simulator (%d)\n", r);
+    return 1;
+  }
+  if ((r = sunxi_hw_init(SUNXI_HW_ALL)) < 0) {
+    fprintf(stderr, "Unable to initialize interfaces (%d)\n", r);
+    return 1;
+  }
+  if (sunxi_bench.spi == NULL) {
+    sunxi_spi_set_ioctl(sunxi_sim_spi_ioctl);
+    fd = sunxi_spi_open("/dev/null");
+  } else {
+    fd = sunxi_spi_open(sunxi_bench.spi);
+  }
+  if (fd < 0) {
+    fprintf(stderr, "Unable to open SPI device\n");
+    return 1;
+  }
+
+  if (!sunxi_bench.json) {
+    printf("%-28s %10s %10s %10s %10s %14s\n", "benchmark", "mean(ns)", "p50(ns)", "p99(ns)", "max(ns)", "ops/s");
+  }
+
+  /* GPIO benchmarks */
+  pin = sunxi_bench.pin;
+  bank = pin >> 5;
+  regs = sunxi_gpio_get_registers();
+  sunxi_gpio_set_cfgpin(pin, SUNXI_GPIO_OUTPUT);
+  SUNXI_BENCH("gpio_output", SUNXI_BENCH_BATCH, sunxi_gpio_output(pin, i & 1));
+  SUNXI_BENCH("gpio_input", SUNXI_BENCH_BATCH, sunxi_bench_sink = sunxi_gpio_input(pin));
+  SUNXI_BENCH("gpio_fast_output", SUNXI_BENCH_BATCH, sunxi_gpio_fast_output(regs, pin, i & 1));
+  SUNXI_BENCH("gpio_fast_input", SUNXI_BENCH_BATCH, sunxi_bench_sink = sunxi_gpio_fast_input(regs, pin));
+  SUNXI_BENCH("gpio_bank_write", SUNXI_BENCH_BATCH, sunxi_gpio_bank_write(bank, 0xFF << (pin & 0x1F), i << (pin & 0x1F)));
+  SUNXI_BENCH("gpio_bank_read", SUNXI_BENCH_BATCH, sunxi_gpio_bank_read(bank, &val); sunxi_bench_sink = val);
+  SUNXI_BENCH("gpio_set_cfgpin", SUNXI_BENCH_BATCH, sunxi_gpio_set_cfgpin(pin, SUNXI_GPIO_OUTPUT));
+  sunxi_gpio_shadow_enable();
+  SUNXI_BENCH("gpio_set_cfgpin_shadow", SUNXI_BENCH_BATCH, sunxi_gpio_set_cfgpin(pin, SUNXI_GPIO_OUTPUT));
+  SUNXI_BENCH("gpio_output_shadow", SUNXI_BENCH_BATCH, sunxi_gpio_output(pin, i & 1));
+  sunxi_gpio_shadow_disable();
+  sunxi_lock_set_mode(SUNXI_LOCK_MODE_THREAD);
+  SUNXI_BENCH("gpio_output_locked", SUNXI_BENCH_BATCH, sunxi_gpio_output(pin, i & 1));
+  sunxi_lock_set_mode(SUNXI_LOCK_MODE_NONE);
+
+  /* GPIO contention benchmarks, lost updates are expected without locking */
+  sunxi_bench_contention("gpio_contention_nolock", SUNXI_LOCK_MODE_NONE);
+  sunxi_bench_contention("gpio_contention_thread", SUNXI_LOCK_MODE_THREAD);
+  sunxi_bench_contention("gpio_contention_process", SUNXI_LOCK_MODE_PROCESS);
+
+  /* PWM benchmarks */
+  SUNXI_BENCH("pwm_set_config", SUNXI_BENCH_BATCH, sunxi_pwm_set_config(SUNXI_PWM_CH0, 1000000, 1000 * (i + 1)));
+  sunxi_pwm_compile(SUNXI_PWM_CH0, 1000000, &pwm_config);
+  sunxi_pwm_apply(&pwm_config, 0);
+  SUNXI_BENCH("pwm_write_duty", SUNXI_BENCH_BATCH, sunxi_pwm_write_duty(&pwm_config, 1000 * (i + 1)));
+  SUNXI_BENCH("pwm_set_duty", SUNXI_BENCH_BATCH, sunxi_pwm_set_duty(SUNXI_PWM_CH0, 1000 * (i + 1)));
+  if (sunxi_pwm_servo_init(&servo, 20000, 500, 2500, 180) == 0) {
+    sunxi_pwm_servo_enable(&servo, SUNXI_PWM_SERVO_CH0 | SUNXI_PWM_SERVO_CH1);
+    SUNXI_BENCH("pwm_servo_write_sync_angle", SUNXI_BENCH_BATCH, sunxi_pwm_servo_write_sync_angle(&servo, i % 1800, 1800 - i % 1800));
+    sunxi_pwm_servo_deinit(&servo);
+  }
+  SUNXI_BENCH("pwm_set_channels", SUNXI_BENCH_BATCH, sunxi_pwm_set_channels(SUNXI_PWM_STATE_ENABLE, i & SUNXI_PWM_STATE_ENABLE));
+
+  /* LRADC benchmarks */
+  SUNXI_BENCH("lradc_read", SUNXI_BENCH_BATCH, sunxi_lradc_read(SUNXI_LRADC_CH0, &val); sunxi_bench_sink = val);
+
+  /* SPI benchmarks */
+  memset(tx, 0x55, sizeof(tx));
+  SUNXI_BENCH("spi_transfer_4", 1, sunxi_spi_transfer(fd, tx, rx, 4));
+  SUNXI_BENCH("spi_transfer_64", 1, sunxi_spi_transfer(fd, tx, rx, 64));
+  SUNXI_BENCH("spi_transfer_4096", 1, sunxi_spi_transfer(fd, tx, rx, 4096));
+  SUNXI_BENCH("spi_transfer_3x", 1, sunxi_spi_transfer(fd, tx, rx, 1); sunxi_spi_transfer(fd, tx, rx, 3); sunxi_spi_transfer(fd, tx, rx, 64));
+  SUNXI_BENCH("spi_transfer_large_150k", 1, sunxi_spi_transfer_large(fd, frame, NULL, sizeof(frame), 0, 0));
+  sunxi_spi_message_init(&message, transfers, 3);
+  SUNXI_BENCH("spi_message_3_segments", 1,
+              sunxi_spi_message_reset(&message);
+              sunxi_spi_message_add(&message, tx, rx, 1, 0, 0, 0, 0);
+              sunxi_spi_message_add(&message, tx, rx, 3, 0, 0, 0, 0);
+              sunxi_spi_message_add(&message, tx, rx, 64, 0, 0, 0, 0);
+              sunxi_spi_message_submit(fd, &message));
+  SUNXI_BENCH("spi_config_transfer_64", 1,
+              sunxi_spi_write_mode(fd, SPI_MODE_0);
+              sunxi_spi_write_bits(fd, 8);
+              sunxi_spi_write_max_speed(fd, 1000000);
+              sunxi_spi_transfer(fd, tx, rx, 64));
+  sunxi_spi_device_open(&device, (sunxi_bench.spi == NULL) ? "/dev/null" : sunxi_bench.spi);
+  SUNXI_BENCH("spi_device_transfer_64", 1,
+              sunxi_spi_device_configure(&device, SPI_MODE_0, 8, 1000000);
+              sunxi_spi_device_transfer(&device, tx, rx, 64));
+  sunxi_spi_device_close(&device);
+  sunxi_spi_pool_init(&pool, 4, 64);
+  buffer = sunxi_spi_pool_get(&pool);
+  SUNXI_BENCH("spi_pool_transfer_64", 1, sunxi_spi_pool_transfer(fd, &pool, buffer, &buffer, 64));
+  sunxi_spi_pool_put(&pool, buffer);
+  sunxi_spi_pool_deinit(&pool);
+  sunxi_spi_queue_open(&queue, fd);
+  SUNXI_BENCH("spi_queue_3_requests", 1,
+              sunxi_spi_queue_submit(&queue, tx, rx, 1, 0, 0, 0, NULL, NULL);
+              sunxi_spi_queue_submit(&queue, tx, rx, 3, 0, 0, 0, NULL, NULL);
+              sunxi_spi_queue_submit(&queue, tx, rx, 64, 0, 0, 0, NULL, NULL);
+              sunxi_spi_queue_flush(&queue));
+  sunxi_spi_queue_close(&queue);
+
+  /* SPI flash, against the simulated flash only */
+  if (sunxi_bench.spi == NULL) {
+    sunxi_spi_set_ioctl(sunxi_sim_spi_flash_ioctl);
+    if ((r = sunxi_spi_flash_open(&flash, fd, 0)) == 0) {
+      SUNXI_BENCH("spi_flash_erase_write_4k", 1,
+                  r |= sunxi_spi_flash_erase_sector(&flash, 0);
+                  r |= sunxi_spi_flash_write(&flash, 0, tx, sizeof(tx)));
+      SUNXI_BENCH("spi_flash_read_64k", 1, r |= sunxi_spi_flash_read(&flash, 0, frame, 65536));
+
+      /* Last written sector read back */
+      if ((r == 0) && (memcmp(frame, tx, sizeof(tx)) != 0)) {
+        r = EIO;
+      }
+    }
+    sunxi_spi_set_ioctl(sunxi_sim_spi_ioctl);
+    if (r != 0) {
+      fprintf(stderr, "SPI flash check failed (%d)\n", r);
+      failed = 1;
+    }
+  }
+
+  /* SPI display, 320x240 frame with a 16x16 area redrawn */
+  if (sunxi_spi_display_init(&display, fd, pin, 320, 240, 0) == 0) {
+    SUNXI_BENCH("spi_display_convert_16x16", 1, sunxi_spi_display_draw_rgb888(&display, 100, 50, 16, 16, tx, 16 * 3));
+    SUNXI_BENCH("spi_display_update_16x16", 1,
+                tx[0]++;
+                sunxi_spi_display_draw_rgb888(&display, 100, 50, 16, 16, tx, 16 * 3);
+                sunxi_spi_display_update(&display));
+    SUNXI_BENCH("spi_display_update_full", 1,
+                sunxi_spi_display_invalidate(&display);
+                sunxi_spi_display_update(&display));
+    sunxi_spi_display_deinit(&display);
+  }
+
+  /* Release interfaces */
+  sunxi_spi_close(fd);
+  sunxi_hw_deinit();
+  if (!sunxi_bench.hw) sunxi_sim_deinit();
+  free(sunxi_bench.times);
+
+  return failed;
+}
@@ -6,7 +6,11 @@
 /* Includes                                                                             */
 /****************************************************************************************/
 
+#include <stddef.h>
+
 #include "gpio.h"
+#include "hw.h"
+#include "lock.h"
 
 
 /****************************************************************************************/
@@ -21,6 +25,26 @@
 #define SUNXI_GPIO_NUM(pin)                     ((pin) & 0x1F)
 #define SUNXI_GPIO_CFG_INDEX(pin)               (((pin) & 0x1F) >> 3)
 #define SUNXI_GPIO_CFG_OFFSET(pin)              ((((pin) & 0x1F) & 0x7) << 2)
+#define SUNXI_GPIO_PULL_INDEX(pin)              (((pin) & 0x1F) >> 4)
+#define SUNXI_GPIO_PULL_OFFSET(pin)             ((((pin) & 0x1F) & 0xF) << 1)
+#define SUNXI_GPIO_DRV_INDEX(pin)               (((pin) & 0x1F) >> 4)
+#define SUNXI_GPIO_DRV_OFFSET(pin)              ((((pin) & 0x1F) & 0xF) << 1)
+
+/* Index of the registers in a bank */
+#define SUNXI_GPIO_REG_CFG                      0
+#define SUNXI_GPIO_REG_DAT                      4
+#define SUNXI_GPIO_REG_DRV                      5
+#define SUNXI_GPIO_REG_PULL                     7
+
+/* Macros used to configure GPIO external interrupts */
+#define SUNXI_GPIO_INT_COUNT                    32
+#define SUNXI_GPIO_INT_CFG_INDEX(eint)          ((eint) >> 3)
+#define SUNXI_GPIO_INT_CFG_OFFSET(eint)         (((eint) & 0x7) << 2)
+#define SUNXI_GPIO_INT_DEB_CLK_SELECT(clk)      ((clk) & 0x1)
+#define SUNXI_GPIO_INT_DEB_CLK_PRE_SCALE(pre)   (((pre) & 0x7) << 4)
+
+/* Size of the external interrupt events queue */
+#define SUNXI_GPIO_EVENT_QUEUE_SIZE             64
 
 /* SUNXI GPIO Bank */
 struct sunxi_gpio_bank {
@@ -32,7 +56,7 @@ struct sunxi_gpio_bank {
 
 /* SUNXI GPIO Interrupt control */
 struct sunxi_gpio_int {
-  volatile unsigned int cfg[3];
+  volatile unsigned int cfg[4];
   volatile unsigned int ctl;
   volatile unsigned int sta;
   volatile unsigned int deb;
@@ -40,11 +64,32 @@ struct sunxi_gpio_int {
 
 /* SUNXI GPIO Registers */
 struct sunxi_gpio_reg {
-  volatile struct sunxi_gpio_bank gpio_bank[9];
+  volatile struct sunxi_gpio_bank gpio_bank[SUNXI_GPIO_BANK_COUNT];
   volatile unsigned char res[0xbc];
   volatile struct sunxi_gpio_int gpio_int;
 };
 
+/* Check consistency with the registers layout used by the inline fast path */
+_Static_assert(sizeof(struct sunxi_gpio_bank) == SUNXI_GPIO_BANK_REGS * sizeof(unsigned int), "Invalid GPIO bank layout");
+_Static_assert(offsetof(struct sunxi_gpio_bank, dat) == 4 * sizeof(unsigned int), "Invalid GPIO bank layout");
+_Static_assert(offsetof(struct sunxi_gpio_bank, drv) == SUNXI_GPIO_REG_DRV * sizeof(unsigned int), "Invalid GPIO bank layout");
+_Static_assert(offsetof(struct sunxi_gpio_bank, pull) == SUNXI_GPIO_REG_PULL * sizeof(unsigned int), "Invalid GPIO bank layout");
+_Static_assert(offsetof(struct sunxi_gpio_reg, gpio_int) == 0x200, "Invalid GPIO interrupt layout");
+
+/* SUNXI GPIO external interrupt events monitor */
+struct sunxi_gpio_event_monitor {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  volatile int running;
+  int efd;
+  int uio;
+  unsigned int period_us;
+  struct sunxi_gpio_event queue[SUNXI_GPIO_EVENT_QUEUE_SIZE];
+  unsigned int head;
+  unsigned int count;
+  unsigned int lost;
+};
+
 
 /****************************************************************************************/
 /* Global variables                                                                     */
@@ -53,45 +98,299 @@ struct sunxi_gpio_reg {
 /* SUNXI GPIO registers */
 static volatile struct sunxi_gpio_reg *sunxi_gpio_registers = NULL;
 
+/* SUNXI GPIO interface users, the interface is released by the last one, counted under the init mutex */
+static unsigned int sunxi_gpio_init_count = 0;
+static pthread_mutex_t sunxi_gpio_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* SUNXI GPIO shadow registers, cfg/dat/drv/pull of all the banks */
+static unsigned int sunxi_gpio_shadow[SUNXI_GPIO_BANK_COUNT * SUNXI_GPIO_BANK_REGS];
+static int sunxi_gpio_shadow_enabled = 0;
+
+/* SUNXI GPIO external interrupt events monitor */
+static struct sunxi_gpio_event_monitor sunxi_gpio_event_monitor = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .efd = -1,
+  .uio = -1
+};
+
+
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Write masked bits of a register, in a single store when all the bits are written
+ * @param reg Register to be written
+ * @param mask Bits to be written
+ * @param val Value of the bits to be written
+ */
+static inline void sunxi_gpio_write_masked(volatile unsigned int *reg, unsigned int mask, unsigned int val) {
+
+  unsigned long index = reg - (volatile unsigned int *)sunxi_gpio_registers->gpio_bank;
+  struct sunxi_lock *lock;
+
+  /* Registers outside of the banks are not written, the callers check the bank */
+  if (index >= SUNXI_GPIO_BANK_COUNT * SUNXI_GPIO_BANK_REGS) {
+    return;
+  }
+  lock = sunxi_lock(SUNXI_LOCK_GPIO_BANK(index / SUNXI_GPIO_BANK_REGS));
+
+  /* Modify the shadow register and store it, the register is not read */
+  if (sunxi_gpio_shadow_enabled) {
+    sunxi_gpio_shadow[index] = (sunxi_gpio_shadow[index] & ~mask) | (val & mask);
+    *reg = sunxi_gpio_shadow[index];
+  } else if (mask == 0xFFFFFFFF) {
+    *reg = val;
+  } else {
+    *reg = (*reg & ~mask) | (val & mask);
+  }
+
+  sunxi_unlock(lock);
+}
+
+/**
+ * Read a configuration register, from the shadow registers if enabled
+ * @param reg Register to be read, cfg, drv or pull register of a bank
+ * @return Register value
+ */
+static inline unsigned int sunxi_gpio_read_config(volatile unsigned int *reg) {
+
+  unsigned long index = reg - (volatile unsigned int *)sunxi_gpio_registers->gpio_bank;
+
+  if (sunxi_gpio_shadow_enabled && (index < SUNXI_GPIO_BANK_COUNT * SUNXI_GPIO_BANK_REGS))
+    return sunxi_gpio_shadow[index];
+  return *reg;
+}
+
+/**
+ * Load the shadow registers of a bank from the registers
+ * @param bank Expected bank
+ */
+static void sunxi_gpio_shadow_load(unsigned int bank) {
+
+  volatile unsigned int *regs = (volatile unsigned int *)&(sunxi_gpio_registers->gpio_bank[bank]);
+  struct sunxi_lock *lock = sunxi_lock(SUNXI_LOCK_GPIO_BANK(bank));
+  unsigned int index;
+
+  for (index = 0; index < SUNXI_GPIO_BANK_REGS; index++) {
+    sunxi_gpio_shadow[bank * SUNXI_GPIO_BANK_REGS + index] = regs[index];
+  }
+
+  sunxi_unlock(lock);
+}
+
+/**
+ * Set a 2 bits field of several pins of a bank, pull and drive registers
+ * @param regs First register of the field, pull[0] or drv[0]
+ * @param mask Pins to be written, bit N set to write pin N of the bank
+ * @param val Expected field value
+ */
+static void sunxi_gpio_write_field2(volatile unsigned int *regs, unsigned int mask, unsigned int val) {
+
+  unsigned int index, num, reg_mask, reg_val;
+
+  for (index = 0; index < 2; index++) {
+    reg_mask = 0;
+    reg_val = 0;
+    for (num = index << 4; num < (index + 1) << 4; num++) {
+      if (mask & (1U << num)) {
+        reg_mask |= 0x3 << ((num & 0xF) << 1);
+        reg_val |= val << ((num & 0xF) << 1);
+      }
+    }
+    if (reg_mask != 0) {
+      sunxi_gpio_write_masked(&regs[index], reg_mask, reg_val);
+    }
+  }
+}
+
+/**
+ * Get external interrupt number of a pin
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @return External interrupt number if the pin is interrupt capable, error code otherwise
+ */
+static int sunxi_gpio_int_number(unsigned int pin) {
+
+  /* EINT0 to EINT21 are PH0 to PH21, EINT22 to EINT31 are PI10 to PI19 */
+  if ((pin >= SUNXI_GPIO_PIN('H', 0)) && (pin <= SUNXI_GPIO_PIN('H', 21)))
+    return pin - SUNXI_GPIO_PIN('H', 0);
+  if ((pin >= SUNXI_GPIO_PIN('I', 10)) && (pin <= SUNXI_GPIO_PIN('I', 19)))
+    return pin - SUNXI_GPIO_PIN('I', 10) + 22;
+  return -EINVAL;
+}
+
+/**
+ * Get pin of an external interrupt number
+ * @param eint External interrupt number
+ * @return Pin, see SUNXI_GPIO_PIN macros
+ */
+static unsigned int sunxi_gpio_int_pin(unsigned int eint) {
+
+  if (eint < 22)
+    return SUNXI_GPIO_PIN('H', eint);
+  return SUNXI_GPIO_PIN('I', eint - 22 + 10);
+}
+
+/**
+ * Push external interrupt event to the queue, to be called with the monitor mutex locked
+ * @param pin Pin of the event
+ * @param timestamp Time of the event
+ */
+static void sunxi_gpio_event_push(unsigned int pin, struct timespec *timestamp) {
+
+  struct sunxi_gpio_event_monitor *monitor = &sunxi_gpio_event_monitor;
+  struct sunxi_gpio_event *event;
+  uint64_t one = 1;
+
+  /* Drop the event if the queue is full, it is reported with the next one */
+  if (monitor->count == SUNXI_GPIO_EVENT_QUEUE_SIZE) {
+    monitor->lost++;
+    return;
+  }
+
+  /* Queue the event and signal it */
+  event = &monitor->queue[(monitor->head + monitor->count) % SUNXI_GPIO_EVENT_QUEUE_SIZE];
+  event->pin = pin;
+  event->lost = monitor->lost;
+  event->timestamp = *timestamp;
+  monitor->lost = 0;
+  monitor->count++;
+  if (write(monitor->efd, &one, sizeof(one)) != sizeof(one)) {
+    monitor->count--;
+    monitor->lost++;
+  }
+}
+
+/**
+ * External interrupt events monitor thread
+ * @param arg Not used
+ * @return Always NULL
+ */
+static void *sunxi_gpio_event_thread(void *arg) {
+
+  struct sunxi_gpio_event_monitor *monitor = &sunxi_gpio_event_monitor;
+  volatile struct sunxi_gpio_int *gpio_int = &(sunxi_gpio_registers->gpio_int);
+  struct pollfd pfd;
+  struct timespec timestamp;
+  unsigned int sta, eint;
+  uint32_t info;
+
+  (void)arg;
+
+  while (monitor->running) {
+
+    /* Wait for interrupt from the UIO device, or for the next polling period */
+    if (monitor->uio >= 0) {
+      pfd.fd = monitor->uio;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, 100) <= 0) continue;
+      if (read(monitor->uio, &info, sizeof(info)) != sizeof(info)) continue;
+    } else {
+      usleep(monitor->period_us);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &timestamp);
+
+    /* Acknowledge pending interrupts and queue the events */
+    sta = gpio_int->sta & gpio_int->ctl;
+    if (sta != 0) {
+      sunxi_hw_write1c(&gpio_int->sta, sta);
+      pthread_mutex_lock(&monitor->mutex);
+      for (eint = 0; eint < SUNXI_GPIO_INT_COUNT; eint++) {
+        if (sta & (1U << eint)) {
+          sunxi_gpio_event_push(sunxi_gpio_int_pin(eint), &timestamp);
+        }
+      }
+      pthread_mutex_unlock(&monitor->mutex);
+    }
+
+    /* Re-enable interrupt of the UIO device */
+    if (monitor->uio >= 0) {
+      info = 1;
+      if (write(monitor->uio, &info, sizeof(info)) != sizeof(info)) continue;
+    }
+  }
+
+  return NULL;
+}
+
 
 /****************************************************************************************/
 /* Exported functions                                                                   */
 /****************************************************************************************/
 
 /**
- * Initialize GPIO interface, to be called once
+ * Initialize GPIO interface, the registers are mapped at first call
+ * Calls can be nested, each call must be balanced with a call to sunxi_gpio_deinit.
  * @return 0 if the function succeeds, error code otherwise
  */
 int sunxi_gpio_init() {
   
-  int fd;
-  unsigned int page_size, page_mask;
-  unsigned int addr_start, addr_offset;
-  void *pc;
-
-  /* Open device */
-  fd = open("/dev/mem", O_RDWR);
-  if (fd < 0) {
-    return -errno;
+  int r = 0;
+
+  pthread_mutex_lock(&sunxi_gpio_init_mutex);
+
+  /* Check if initialization has already been performed */
+  if (sunxi_gpio_registers != NULL) {
+    sunxi_gpio_init_count++;
+    goto exit;
   }
-  
+
   /* Map to device */
-  page_size = sysconf(_SC_PAGESIZE);
-  page_mask = (~(page_size-1));
-  addr_start = SUNXI_GPIO_IO_BASE & page_mask;
-  addr_offset = SUNXI_GPIO_IO_BASE & ~page_mask;
-  pc = (void *)mmap(NULL, (((sizeof(struct sunxi_gpio_reg) + addr_offset) / page_size) + 1) * page_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, addr_start);
-  if (pc == MAP_FAILED) {
-    return -errno;
+  if ((r = sunxi_hw_map()) < 0) {
+    goto exit;
   }
 
   /* Retrieve registers address used later in this library */
-  sunxi_gpio_registers = (struct sunxi_gpio_reg *)(pc + addr_offset);
-
-  /* Close device */
-  close(fd);
+  sunxi_gpio_registers = sunxi_hw_address(SUNXI_GPIO_IO_BASE, sizeof(struct sunxi_gpio_reg));
+  if (sunxi_gpio_registers == NULL) {
+    sunxi_hw_unmap();
+    r = -EFAULT;
+    goto exit;
+  }
   
-  return 0;
+  sunxi_gpio_init_count = 1;
+
+exit:
+  pthread_mutex_unlock(&sunxi_gpio_init_mutex);
+  return r;
+}
+
+/**
+ * Release GPIO interface, released when the last call to sunxi_gpio_init is balanced
+ * The registers are unmapped when no more interface uses them.
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_deinit() {
+
+  int r;
+
+  pthread_mutex_lock(&sunxi_gpio_init_mutex);
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    pthread_mutex_unlock(&sunxi_gpio_init_mutex);
+    return -EPERM;
+  }
+
+  /* Check if the interface is still used */
+  if (--sunxi_gpio_init_count > 0) {
+    pthread_mutex_unlock(&sunxi_gpio_init_mutex);
+    return 0;
+  }
+
+  /* Stop external interrupt events monitoring and disable shadow registers */
+  if (sunxi_gpio_event_monitor.running) {
+    sunxi_gpio_event_close();
+  }
+  sunxi_gpio_shadow_disable();
+
+  /* Release registers */
+  sunxi_gpio_registers = NULL;
+
+  r = sunxi_hw_unmap();
+
+  pthread_mutex_unlock(&sunxi_gpio_init_mutex);
+  return r;
 }
 
 /**
@@ -102,7 +401,6 @@ int sunxi_gpio_init() {
  */
 int sunxi_gpio_set_cfgpin(unsigned int pin, unsigned int val) {
   
-  unsigned int cfg;
   unsigned int bank = SUNXI_GPIO_BANK(pin);
   unsigned int index = SUNXI_GPIO_CFG_INDEX(pin);
   unsigned int offset = SUNXI_GPIO_CFG_OFFSET(pin);
@@ -112,12 +410,14 @@ int sunxi_gpio_set_cfgpin(unsigned int pin, unsigned int val) {
     return -EPERM;
   }
 
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
+
   /* Set pin configuration */
   volatile struct sunxi_gpio_bank *pio = &(sunxi_gpio_registers->gpio_bank[bank]);
-  cfg = *(&pio->cfg[0] + index);
-  cfg &= ~(0xf << offset);
-  cfg |= val << offset;
-  *(&pio->cfg[0] + index) = cfg;
+  sunxi_gpio_write_masked(&pio->cfg[index], 0xf << offset, val << offset);
 
   return 0;
 }
@@ -138,10 +438,15 @@ int sunxi_gpio_get_cfgpin(unsigned int pin) {
   if (sunxi_gpio_registers == NULL) {
     return -EPERM;
   }
+
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
   
   /* Get pin configuration */
   volatile struct sunxi_gpio_bank *pio = &(sunxi_gpio_registers->gpio_bank[bank]);
-  cfg = *(&pio->cfg[0] + index);
+  cfg = sunxi_gpio_read_config(&pio->cfg[index]);
   cfg >>= offset;
   return (cfg & 0xf);
 }
@@ -161,6 +466,11 @@ int sunxi_gpio_input(unsigned int pin) {
   if (sunxi_gpio_registers == NULL) {
     return -EPERM;
   }
+
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
   
   /* Get pin value */
   volatile struct sunxi_gpio_bank *pio = &(sunxi_gpio_registers->gpio_bank[bank]);
@@ -184,12 +494,687 @@ int sunxi_gpio_output(unsigned int pin, unsigned int val) {
   if (sunxi_gpio_registers == NULL) {
     return -EPERM;
   }
+
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
   
   /* Set pin value */
   volatile struct sunxi_gpio_bank *pio = &(sunxi_gpio_registers->gpio_bank[bank]);
+  sunxi_gpio_write_masked(&pio->dat, 1U << num, val ? (1U << num) : 0);
+  return 0;
+}
+
+/**
+ * Get input value of all the pins of a bank
+ * @param bank Expected bank, 0 for port A, 1 for port B, etc. (see SUNXI_GPIO_PORT macro)
+ * @param val Bank input value, bit N is the value of pin N of the bank
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_bank_read(unsigned int bank, unsigned int *val) {
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
+
+  /* Get bank value */
+  *val = sunxi_gpio_registers->gpio_bank[bank].dat;
+  return 0;
+}
+
+/**
+ * Set output value of several pins of a bank at once, the pins change on the same edge
+ * @param bank Expected bank, 0 for port A, 1 for port B, etc. (see SUNXI_GPIO_PORT macro)
+ * @param mask Pins to be written, bit N set to write pin N of the bank
+ * @param val Expected pins value, bit N is the value of pin N of the bank
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_bank_write(unsigned int bank, unsigned int mask, unsigned int val) {
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
+
+  /* Set bank value */
+  if (mask != 0) {
+    sunxi_gpio_write_masked(&sunxi_gpio_registers->gpio_bank[bank].dat, mask, val);
+  }
+  return 0;
+}
+
+/**
+ * Add a pin to a port set, no register is accessed
+ * @param set Port set to be updated
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @param val Expected pin value, 0 or 1
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_port_set_pin(struct sunxi_gpio_port_set *set, unsigned int pin, unsigned int val) {
+
+  unsigned int bank = SUNXI_GPIO_BANK(pin);
+  unsigned int num = SUNXI_GPIO_NUM(pin);
+
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
+
+  /* Add pin to the set */
+  set->mask[bank] |= 1U << num;
   if (val)
-    *(&pio->dat) |= 1 << num;
+    set->val[bank] |= 1U << num;
   else
-    *(&pio->dat) &= ~(1 << num);
+    set->val[bank] &= ~(1U << num);
+  return 0;
+}
+
+/**
+ * Get input value of the pins of a port set, one register access per bank of the set
+ * @param set Port set, the value of the pins selected by the masks is updated
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_port_read(struct sunxi_gpio_port_set *set) {
+
+  unsigned int bank;
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Get value of the banks */
+  for (bank = 0; bank < SUNXI_GPIO_BANK_COUNT; bank++) {
+    if (set->mask[bank] != 0) {
+      set->val[bank] = sunxi_gpio_registers->gpio_bank[bank].dat & set->mask[bank];
+    }
+  }
+  return 0;
+}
+
+/**
+ * Set output value of the pins of a port set, one register access per bank of the set
+ * @param set Port set, the pins selected by the masks are written
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_port_write(struct sunxi_gpio_port_set *set) {
+
+  unsigned int bank;
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Set value of the banks */
+  for (bank = 0; bank < SUNXI_GPIO_BANK_COUNT; bank++) {
+    if (set->mask[bank] != 0) {
+      sunxi_gpio_write_masked(&sunxi_gpio_registers->gpio_bank[bank].dat, set->mask[bank], set->val[bank]);
+    }
+  }
+  return 0;
+}
+
+/**
+ * Get GPIO registers, to be used with the inline fast path functions
+ * @return GPIO registers if the initialization has been performed, NULL otherwise
+ */
+volatile unsigned int *sunxi_gpio_get_registers() {
+  return (volatile unsigned int *)sunxi_gpio_registers;
+}
+
+/**
+ * Set pin pull configuration
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @param pull Expected pull, SUNXI_GPIO_PULL_DISABLE, SUNXI_GPIO_PULL_UP or SUNXI_GPIO_PULL_DOWN
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_set_pull(unsigned int pin, unsigned int pull) {
+
+  return sunxi_gpio_bank_set_pull(SUNXI_GPIO_BANK(pin), 1U << SUNXI_GPIO_NUM(pin), pull);
+}
+
+/**
+ * Get pin pull configuration
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @return Pin pull if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_get_pull(unsigned int pin) {
+
+  unsigned int pull;
+  unsigned int bank = SUNXI_GPIO_BANK(pin);
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
+
+  /* Get pin pull */
+  volatile struct sunxi_gpio_bank *pio = &(sunxi_gpio_registers->gpio_bank[bank]);
+  pull = sunxi_gpio_read_config(&pio->pull[SUNXI_GPIO_PULL_INDEX(pin)]);
+  pull >>= SUNXI_GPIO_PULL_OFFSET(pin);
+  return (pull & 0x3);
+}
+
+/**
+ * Set pin drive level configuration
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @param drv Expected drive level, SUNXI_GPIO_DRV_LEVEL0 to SUNXI_GPIO_DRV_LEVEL3
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_set_drv(unsigned int pin, unsigned int drv) {
+
+  return sunxi_gpio_bank_set_drv(SUNXI_GPIO_BANK(pin), 1U << SUNXI_GPIO_NUM(pin), drv);
+}
+
+/**
+ * Get pin drive level configuration
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @return Pin drive level if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_get_drv(unsigned int pin) {
+
+  unsigned int drv;
+  unsigned int bank = SUNXI_GPIO_BANK(pin);
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
+
+  /* Get pin drive level */
+  volatile struct sunxi_gpio_bank *pio = &(sunxi_gpio_registers->gpio_bank[bank]);
+  drv = sunxi_gpio_read_config(&pio->drv[SUNXI_GPIO_DRV_INDEX(pin)]);
+  drv >>= SUNXI_GPIO_DRV_OFFSET(pin);
+  return (drv & 0x3);
+}
+
+/**
+ * Set pull configuration of several pins of a bank, each pull register is written once
+ * @param bank Expected bank, 0 for port A, 1 for port B, etc. (see SUNXI_GPIO_PORT macro)
+ * @param mask Pins to be configured, bit N set to configure pin N of the bank
+ * @param pull Expected pull, SUNXI_GPIO_PULL_DISABLE, SUNXI_GPIO_PULL_UP or SUNXI_GPIO_PULL_DOWN
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_bank_set_pull(unsigned int bank, unsigned int mask, unsigned int pull) {
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check bank and pull */
+  if ((bank >= SUNXI_GPIO_BANK_COUNT) || (pull > SUNXI_GPIO_PULL_DOWN)) {
+    return -EINVAL;
+  }
+
+  /* Set pins pull */
+  sunxi_gpio_write_field2(&sunxi_gpio_registers->gpio_bank[bank].pull[0], mask, pull);
+
+  return 0;
+}
+
+/**
+ * Set drive level configuration of several pins of a bank, each drive register is written once
+ * @param bank Expected bank, 0 for port A, 1 for port B, etc. (see SUNXI_GPIO_PORT macro)
+ * @param mask Pins to be configured, bit N set to configure pin N of the bank
+ * @param drv Expected drive level, SUNXI_GPIO_DRV_LEVEL0 to SUNXI_GPIO_DRV_LEVEL3
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_bank_set_drv(unsigned int bank, unsigned int mask, unsigned int drv) {
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check bank and drive level */
+  if ((bank >= SUNXI_GPIO_BANK_COUNT) || (drv > SUNXI_GPIO_DRV_LEVEL3)) {
+    return -EINVAL;
+  }
+
+  /* Set pins drive level */
+  sunxi_gpio_write_field2(&sunxi_gpio_registers->gpio_bank[bank].drv[0], mask, drv);
+
+  return 0;
+}
+
+/**
+ * Apply a table of pin configurations, each register is written at most once
+ * The pull, drive level and output value are applied before the function, so that pins
+ * configured as output start at the expected level.
+ * @param config Table of pin configurations, fields can be set to SUNXI_GPIO_UNCHANGED
+ * @param count Number of pin configurations in the table
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_set_config(struct sunxi_gpio_pin_config *config, unsigned int count) {
+
+  unsigned int mask[SUNXI_GPIO_BANK_COUNT][SUNXI_GPIO_BANK_REGS];
+  unsigned int val[SUNXI_GPIO_BANK_COUNT][SUNXI_GPIO_BANK_REGS];
+  static const unsigned int order[SUNXI_GPIO_BANK_REGS] = {
+    SUNXI_GPIO_REG_PULL, SUNXI_GPIO_REG_PULL + 1, SUNXI_GPIO_REG_DRV, SUNXI_GPIO_REG_DRV + 1, SUNXI_GPIO_REG_DAT,
+    SUNXI_GPIO_REG_CFG, SUNXI_GPIO_REG_CFG + 1, SUNXI_GPIO_REG_CFG + 2, SUNXI_GPIO_REG_CFG + 3
+  };
+  unsigned int index, bank, reg, pin;
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check configurations */
+  for (index = 0; index < count; index++) {
+    if ((SUNXI_GPIO_BANK(config[index].pin) >= SUNXI_GPIO_BANK_COUNT)
+        || ((config[index].function != SUNXI_GPIO_UNCHANGED) && (config[index].function > 0x7))
+        || ((config[index].pull != SUNXI_GPIO_UNCHANGED) && (config[index].pull > SUNXI_GPIO_PULL_DOWN))
+        || ((config[index].drv != SUNXI_GPIO_UNCHANGED) && (config[index].drv > SUNXI_GPIO_DRV_LEVEL3))) {
+      return -EINVAL;
+    }
+  }
+
+  /* Merge configurations per register */
+  memset(mask, 0, sizeof(mask));
+  memset(val, 0, sizeof(val));
+  for (index = 0; index < count; index++) {
+    pin = config[index].pin;
+    bank = SUNXI_GPIO_BANK(pin);
+    if (config[index].function != SUNXI_GPIO_UNCHANGED) {
+      reg = SUNXI_GPIO_REG_CFG + SUNXI_GPIO_CFG_INDEX(pin);
+      mask[bank][reg] |= 0xf << SUNXI_GPIO_CFG_OFFSET(pin);
+      val[bank][reg] = (val[bank][reg] & ~(0xf << SUNXI_GPIO_CFG_OFFSET(pin))) | (config[index].function << SUNXI_GPIO_CFG_OFFSET(pin));
+    }
+    if (config[index].val != SUNXI_GPIO_UNCHANGED) {
+      reg = SUNXI_GPIO_REG_DAT;
+      mask[bank][reg] |= 1U << SUNXI_GPIO_NUM(pin);
+      val[bank][reg] = (val[bank][reg] & ~(1U << SUNXI_GPIO_NUM(pin))) | ((config[index].val ? 1U : 0) << SUNXI_GPIO_NUM(pin));
+    }
+    if (config[index].drv != SUNXI_GPIO_UNCHANGED) {
+      reg = SUNXI_GPIO_REG_DRV + SUNXI_GPIO_DRV_INDEX(pin);
+      mask[bank][reg] |= 0x3 << SUNXI_GPIO_DRV_OFFSET(pin);
+      val[bank][reg] = (val[bank][reg] & ~(0x3 << SUNXI_GPIO_DRV_OFFSET(pin))) | (config[index].drv << SUNXI_GPIO_DRV_OFFSET(pin));
+    }
+    if (config[index].pull != SUNXI_GPIO_UNCHANGED) {
+      reg = SUNXI_GPIO_REG_PULL + SUNXI_GPIO_PULL_INDEX(pin);
+      mask[bank][reg] |= 0x3 << SUNXI_GPIO_PULL_OFFSET(pin);
+      val[bank][reg] = (val[bank][reg] & ~(0x3 << SUNXI_GPIO_PULL_OFFSET(pin))) | (config[index].pull << SUNXI_GPIO_PULL_OFFSET(pin));
+    }
+  }
+
+  /* Write registers */
+  for (bank = 0; bank < SUNXI_GPIO_BANK_COUNT; bank++) {
+    volatile unsigned int *regs = (volatile unsigned int *)&(sunxi_gpio_registers->gpio_bank[bank]);
+    for (index = 0; index < SUNXI_GPIO_BANK_REGS; index++) {
+      reg = order[index];
+      if (mask[bank][reg] != 0) {
+        sunxi_gpio_write_masked(&regs[reg], mask[bank][reg], val[bank][reg]);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Enable shadow registers, the cfg/dat/drv/pull registers of all the banks are read once and
+ * further modifications are performed on the shadow registers, then stored without reading the
+ * registers. Registers modified by other software (or with the inline fast path) must be
+ * synchronized with sunxi_gpio_shadow_sync. Input values are always read from the registers.
+ * The shadow registers are private to the process, they cannot be used with SUNXI_LOCK_MODE_PROCESS
+ * (the stores of a process would overwrite the modifications of the others), which is refused
+ * by sunxi_lock_set_mode while they are enabled.
+ * @return 0 if the function succeeds, -EBUSY with SUNXI_LOCK_MODE_PROCESS, error code otherwise
+ */
+int sunxi_gpio_shadow_enable() {
+
+  int r;
+  unsigned int bank;
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Register as process-unsafe user once, registers shared with other processes are refused */
+  if (!sunxi_gpio_shadow_enabled) {
+    if ((r = sunxi_lock_unsafe_get()) < 0) {
+      return r;
+    }
+  }
+
+  /* Load shadow registers */
+  for (bank = 0; bank < SUNXI_GPIO_BANK_COUNT; bank++) {
+    sunxi_gpio_shadow_load(bank);
+  }
+  sunxi_gpio_shadow_enabled = 1;
+
+  return 0;
+}
+
+/**
+ * Synchronize shadow registers of a bank with the registers
+ * @param bank Expected bank, 0 for port A, 1 for port B, etc. (see SUNXI_GPIO_PORT macro)
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_shadow_sync(unsigned int bank) {
+
+  /* Check if shadow registers are enabled */
+  if (!sunxi_gpio_shadow_enabled) {
+    return -EPERM;
+  }
+
+  /* Check bank */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
+
+  /* Load shadow registers */
+  sunxi_gpio_shadow_load(bank);
+
+  return 0;
+}
+
+/**
+ * Disable shadow registers, further modifications are performed reading the registers
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_shadow_disable() {
+
+  /* Release process-unsafe user */
+  if (sunxi_gpio_shadow_enabled) {
+    sunxi_gpio_shadow_enabled = 0;
+    sunxi_lock_unsafe_put();
+  }
+
+  return 0;
+}
+
+/**
+ * Set external interrupt trigger of a pin, only PH0 to PH21 and PI10 to PI19 are interrupt capable
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @param trigger Expected trigger, SUNXI_GPIO_INT_POSITIVE_EDGE, SUNXI_GPIO_INT_NEGATIVE_EDGE, SUNXI_GPIO_INT_HIGH_LEVEL, SUNXI_GPIO_INT_LOW_LEVEL or SUNXI_GPIO_INT_DOUBLE_EDGE
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_int_set_trigger(unsigned int pin, unsigned int trigger) {
+
+  unsigned int cfg;
+  struct sunxi_lock *lock;
+  int eint = sunxi_gpio_int_number(pin);
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check pin and trigger */
+  if ((eint < 0) || (trigger > SUNXI_GPIO_INT_DOUBLE_EDGE)) {
+    return -EINVAL;
+  }
+
+  /* Set external interrupt trigger */
+  volatile struct sunxi_gpio_int *gpio_int = &(sunxi_gpio_registers->gpio_int);
+  lock = sunxi_lock(SUNXI_LOCK_GPIO_INT);
+  cfg = gpio_int->cfg[SUNXI_GPIO_INT_CFG_INDEX(eint)];
+  cfg &= ~(0xf << SUNXI_GPIO_INT_CFG_OFFSET(eint));
+  cfg |= trigger << SUNXI_GPIO_INT_CFG_OFFSET(eint);
+  gpio_int->cfg[SUNXI_GPIO_INT_CFG_INDEX(eint)] = cfg;
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Set external interrupts debounce, common to all the pins
+ * @param clk Debounce clock, SUNXI_GPIO_INT_CLK_LOSC (32kHz) or SUNXI_GPIO_INT_CLK_HOSC (24MHz)
+ * @param prescale Debounce clock prescaler, the clock is divided by 2^prescale (0 to 7)
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_int_set_debounce(unsigned int clk, unsigned int prescale) {
+
+  struct sunxi_lock *lock;
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check clock and prescaler */
+  if ((clk > SUNXI_GPIO_INT_CLK_HOSC) || (prescale > 7)) {
+    return -EINVAL;
+  }
+
+  /* Set external interrupts debounce, serialized with the other external interrupt register updates */
+  lock = sunxi_lock(SUNXI_LOCK_GPIO_INT);
+  sunxi_gpio_registers->gpio_int.deb = SUNXI_GPIO_INT_DEB_CLK_SELECT(clk) | SUNXI_GPIO_INT_DEB_CLK_PRE_SCALE(prescale);
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Enable external interrupt of a pin, the pin function is set to SUNXI_GPIO_EINT
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_int_enable(unsigned int pin) {
+
+  struct sunxi_lock *lock;
+  int r, eint = sunxi_gpio_int_number(pin);
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check pin */
+  if (eint < 0) {
+    return eint;
+  }
+
+  /* Set pin function */
+  if ((r = sunxi_gpio_set_cfgpin(pin, SUNXI_GPIO_EINT)) < 0) {
+    return r;
+  }
+
+  /* Clear pending interrupt and enable external interrupt */
+  lock = sunxi_lock(SUNXI_LOCK_GPIO_INT);
+  sunxi_hw_write1c(&sunxi_gpio_registers->gpio_int.sta, 1U << eint);
+  sunxi_gpio_registers->gpio_int.ctl |= 1U << eint;
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Disable external interrupt of a pin
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_int_disable(unsigned int pin) {
+
+  struct sunxi_lock *lock;
+  int eint = sunxi_gpio_int_number(pin);
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check pin */
+  if (eint < 0) {
+    return eint;
+  }
+
+  /* Disable external interrupt and clear pending interrupt */
+  lock = sunxi_lock(SUNXI_LOCK_GPIO_INT);
+  sunxi_gpio_registers->gpio_int.ctl &= ~(1U << eint);
+  sunxi_hw_write1c(&sunxi_gpio_registers->gpio_int.sta, 1U << eint);
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Start monitoring of the external interrupt events
+ * The pending interrupts are acknowledged by a monitor thread, woken up by the UIO device bound
+ * to the PIO interrupt if available, or polling the interrupt status register otherwise.
+ * @param uio /dev/uio* path of the PIO interrupt, NULL to poll the interrupt status register
+ * @param period_us Polling period in us, not used with UIO device
+ * @return File descriptor readable when events are pending (poll/epoll) if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_event_open(char *uio, unsigned int period_us) {
+
+  struct sunxi_gpio_event_monitor *monitor = &sunxi_gpio_event_monitor;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_gpio_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check if monitoring is already started */
+  if (monitor->running) {
+    return -EBUSY;
+  }
+
+  /* Open event file descriptor, one event is read at a time */
+  monitor->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
+  if (monitor->efd < 0) {
+    return -errno;
+  }
+
+  /* Open UIO device */
+  if (uio != NULL) {
+    monitor->uio = open(uio, O_RDWR | O_CLOEXEC);
+    if (monitor->uio < 0) {
+      r = -errno;
+      close(monitor->efd);
+      monitor->efd = -1;
+      return r;
+    }
+  }
+
+  /* Start monitor thread */
+  monitor->period_us = period_us;
+  monitor->head = 0;
+  monitor->count = 0;
+  monitor->lost = 0;
+  monitor->running = 1;
+  if ((r = pthread_create(&monitor->thread, NULL, sunxi_gpio_event_thread, NULL)) != 0) {
+    monitor->running = 0;
+    if (monitor->uio >= 0) close(monitor->uio);
+    close(monitor->efd);
+    monitor->uio = -1;
+    monitor->efd = -1;
+    return -r;
+  }
+
+  return monitor->efd;
+}
+
+/**
+ * Read external interrupt event, without blocking
+ * @param event Event read
+ * @return 0 if the function succeeds, -EAGAIN if no event is pending, error code otherwise
+ */
+int sunxi_gpio_event_read(struct sunxi_gpio_event *event) {
+
+  struct sunxi_gpio_event_monitor *monitor = &sunxi_gpio_event_monitor;
+  uint64_t value;
+
+  /* Check if monitoring is started */
+  if (monitor->efd < 0) {
+    return -EPERM;
+  }
+
+  /* Consume one event signal */
+  if (read(monitor->efd, &value, sizeof(value)) != sizeof(value)) {
+    return -errno;
+  }
+
+  /* Retrieve event */
+  pthread_mutex_lock(&monitor->mutex);
+  *event = monitor->queue[monitor->head];
+  monitor->head = (monitor->head + 1) % SUNXI_GPIO_EVENT_QUEUE_SIZE;
+  monitor->count--;
+  pthread_mutex_unlock(&monitor->mutex);
+
+  return 0;
+}
+
+/**
+ * Wait for external interrupt event
+ * @param event Event read
+ * @param timeout_ms Timeout in ms, -1 to wait forever
+ * @return 0 if the function succeeds, -ETIMEDOUT if no event is received, error code otherwise
+ */
+int sunxi_gpio_event_wait(struct sunxi_gpio_event *event, int timeout_ms) {
+
+  struct sunxi_gpio_event_monitor *monitor = &sunxi_gpio_event_monitor;
+  struct pollfd pfd;
+  int r;
+
+  /* Check if monitoring is started */
+  if (monitor->efd < 0) {
+    return -EPERM;
+  }
+
+  /* Wait for event */
+  pfd.fd = monitor->efd;
+  pfd.events = POLLIN;
+  if ((r = poll(&pfd, 1, timeout_ms)) < 0) {
+    return -errno;
+  }
+  if (r == 0) {
+    return -ETIMEDOUT;
+  }
+
+  return sunxi_gpio_event_read(event);
+}
+
+/**
+ * Stop monitoring of the external interrupt events
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_gpio_event_close() {
+
+  struct sunxi_gpio_event_monitor *monitor = &sunxi_gpio_event_monitor;
+
+  /* Check if monitoring is started */
+  if (!monitor->running) {
+    return -EPERM;
+  }
+
+  /* Stop monitor thread */
+  monitor->running = 0;
+  pthread_join(monitor->thread, NULL);
+
+  /* Close file descriptors */
+  if (monitor->uio >= 0) close(monitor->uio);
+  close(monitor->efd);
+  monitor->uio = -1;
+  monitor->efd = -1;
+
   return 0;
 }
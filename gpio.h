@@ -13,9 +13,17 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include "lock.h"
 
 
 /****************************************************************************************/
@@ -26,9 +34,44 @@
 #define SUNXI_GPIO_INPUT                        0
 #define SUNXI_GPIO_OUTPUT                       1
 #define SUNXI_GPIO_PER                          2
+#define SUNXI_GPIO_EINT                         6
+
+/* SUNXI GPIO pin pull configuration */
+#define SUNXI_GPIO_PULL_DISABLE                 0
+#define SUNXI_GPIO_PULL_UP                      1
+#define SUNXI_GPIO_PULL_DOWN                    2
+
+/* SUNXI GPIO pin drive level configuration */
+#define SUNXI_GPIO_DRV_LEVEL0                   0
+#define SUNXI_GPIO_DRV_LEVEL1                   1
+#define SUNXI_GPIO_DRV_LEVEL2                   2
+#define SUNXI_GPIO_DRV_LEVEL3                   3
+
+/* SUNXI GPIO pin configuration field left unchanged */
+#define SUNXI_GPIO_UNCHANGED                    (~0U)
+
+/* SUNXI GPIO external interrupt trigger */
+#define SUNXI_GPIO_INT_POSITIVE_EDGE            0
+#define SUNXI_GPIO_INT_NEGATIVE_EDGE            1
+#define SUNXI_GPIO_INT_HIGH_LEVEL               2
+#define SUNXI_GPIO_INT_LOW_LEVEL                3
+#define SUNXI_GPIO_INT_DOUBLE_EDGE              4
+
+/* SUNXI GPIO external interrupt debounce clock */
+#define SUNXI_GPIO_INT_CLK_LOSC                 0
+#define SUNXI_GPIO_INT_CLK_HOSC                 1
 
 /* SUNXI GPIO macro */
-#define SUNXI_GPIO_PIN(port, pin)               ((port - 'A') << 5) + pin
+#define SUNXI_GPIO_PIN(port, pin)               ((((port) - 'A') << 5) + (pin))
+
+/* SUNXI GPIO bank macros */
+#define SUNXI_GPIO_BANK_COUNT                   9
+#define SUNXI_GPIO_PORT(port)                   ((port) - 'A')
+#define SUNXI_GPIO_PIN_MASK(pin)                (1U << ((pin) & 0x1F))
+
+/* SUNXI GPIO registers layout, used by the inline fast path */
+#define SUNXI_GPIO_BANK_REGS                    9
+#define SUNXI_GPIO_DAT_REG(pin)                 ((((pin) >> 5) * SUNXI_GPIO_BANK_REGS) + 4)
 
 /* SUNXI GPIOs */
 #define SUNXI_GPIO_PIN_PA0                      0
@@ -289,15 +332,115 @@
 #define SUNXI_GPIO_PIN_PH31                     255
 
 
+/****************************************************************************************/
+/* Types                                                                                */
+/****************************************************************************************/
+
+/* SUNXI GPIO port set, masks and values of all the banks */
+struct sunxi_gpio_port_set {
+  unsigned int mask[SUNXI_GPIO_BANK_COUNT];
+  unsigned int val[SUNXI_GPIO_BANK_COUNT];
+};
+
+/* SUNXI GPIO pin configuration, fields can be set to SUNXI_GPIO_UNCHANGED */
+struct sunxi_gpio_pin_config {
+  unsigned int pin;
+  unsigned int function;
+  unsigned int pull;
+  unsigned int drv;
+  unsigned int val;
+};
+
+/* SUNXI GPIO external interrupt event */
+struct sunxi_gpio_event {
+  unsigned int pin;
+  unsigned int lost;
+  struct timespec timestamp;
+};
+
+
 /****************************************************************************************/
 /* Prototypes                                                                           */
 /****************************************************************************************/
 
 int sunxi_gpio_init();
+int sunxi_gpio_deinit();
 int sunxi_gpio_set_cfgpin(unsigned int pin, unsigned int val);
 int sunxi_gpio_get_cfgpin(unsigned int pin);
 int sunxi_gpio_input(unsigned int pin);
 int sunxi_gpio_output(unsigned int pin, unsigned int val);
+int sunxi_gpio_bank_read(unsigned int bank, unsigned int *val);
+int sunxi_gpio_bank_write(unsigned int bank, unsigned int mask, unsigned int val);
+int sunxi_gpio_port_set_pin(struct sunxi_gpio_port_set *set, unsigned int pin, unsigned int val);
+int sunxi_gpio_port_read(struct sunxi_gpio_port_set *set);
+int sunxi_gpio_port_write(struct sunxi_gpio_port_set *set);
+volatile unsigned int *sunxi_gpio_get_registers();
+int sunxi_gpio_set_pull(unsigned int pin, unsigned int pull);
+int sunxi_gpio_get_pull(unsigned int pin);
+int sunxi_gpio_set_drv(unsigned int pin, unsigned int drv);
+int sunxi_gpio_get_drv(unsigned int pin);
+int sunxi_gpio_bank_set_pull(unsigned int bank, unsigned int mask, unsigned int pull);
+int sunxi_gpio_bank_set_drv(unsigned int bank, unsigned int mask, unsigned int drv);
+int sunxi_gpio_set_config(struct sunxi_gpio_pin_config *config, unsigned int count);
+/* Shadow registers are per process, not available with SUNXI_LOCK_MODE_PROCESS */
+int sunxi_gpio_shadow_enable();
+int sunxi_gpio_shadow_sync(unsigned int bank);
+int sunxi_gpio_shadow_disable();
+int sunxi_gpio_int_set_trigger(unsigned int pin, unsigned int trigger);
+int sunxi_gpio_int_set_debounce(unsigned int clk, unsigned int prescale);
+int sunxi_gpio_int_enable(unsigned int pin);
+int sunxi_gpio_int_disable(unsigned int pin);
+int sunxi_gpio_event_open(char *uio, unsigned int period_us);
+int sunxi_gpio_event_read(struct sunxi_gpio_event *event);
+int sunxi_gpio_event_wait(struct sunxi_gpio_event *event, int timeout_ms);
+int sunxi_gpio_event_close();
+
+
+/****************************************************************************************/
+/* Inline fast path                                                                     */
+/****************************************************************************************/
+
+/* The inline fast path accesses the registers directly and bypasses the shadow registers, the
+   writes taking the bank lock only if locking is enabled (see sunxi_lock_set_mode) */
+
+/**
+ * Get pin input value, no initialization check is performed
+ * @param regs GPIO registers get from sunxi_gpio_get_registers
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @return Pin input value
+ */
+static inline unsigned int sunxi_gpio_fast_input(volatile unsigned int *regs, unsigned int pin) {
+  return (regs[SUNXI_GPIO_DAT_REG(pin)] >> (pin & 0x1F)) & 0x1;
+}
+
+/**
+ * Set pin output value, no initialization check is performed
+ * @param regs GPIO registers get from sunxi_gpio_get_registers
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @param val Expected pin value, 0 or 1
+ */
+static inline void sunxi_gpio_fast_output(volatile unsigned int *regs, unsigned int pin, unsigned int val) {
+  struct sunxi_lock *lock = sunxi_lock(SUNXI_LOCK_GPIO_BANK(pin >> 5));
+  if (val)
+    regs[SUNXI_GPIO_DAT_REG(pin)] |= SUNXI_GPIO_PIN_MASK(pin);
+  else
+    regs[SUNXI_GPIO_DAT_REG(pin)] &= ~SUNXI_GPIO_PIN_MASK(pin);
+  sunxi_unlock(lock);
+}
+
+/**
+ * Set output value of several pins of a bank at once, no initialization check is performed
+ * @param regs GPIO registers get from sunxi_gpio_get_registers
+ * @param bank Expected bank, 0 for port A, 1 for port B, etc. (see SUNXI_GPIO_PORT macro)
+ * @param mask Pins to be written, bit N set to write pin N of the bank
+ * @param val Expected pins value, bit N is the value of pin N of the bank
+ */
+static inline void sunxi_gpio_fast_bank_write(volatile unsigned int *regs, unsigned int bank, unsigned int mask, unsigned int val) {
+  volatile unsigned int *dat = &regs[SUNXI_GPIO_DAT_REG(bank << 5)];
+  struct sunxi_lock *lock = sunxi_lock(SUNXI_LOCK_GPIO_BANK(bank));
+  *dat = (*dat & ~mask) | (val & mask);
+  sunxi_unlock(lock);
+}
 
 
 #endif
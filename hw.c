@@ -0,0 +1,268 @@
+/****************************************************************************************/
+/* SUNXI hardware library interface                                                     */
+/****************************************************************************************/
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include "hw.h"
+#include "gpio.h"
+#include "lradc.h"
+#include "pwm.h"
+
+
+/****************************************************************************************/
+/* Global variables                                                                     */
+/****************************************************************************************/
+
+/* SUNXI hardware device */
+static char sunxi_hw_device[256] = SUNXI_HW_DEVICE;
+
+/* SUNXI hardware backend, file descriptor and offset of the IO window, used instead of the device if defined */
+static int sunxi_hw_backend_fd = -1;
+static unsigned long sunxi_hw_backend_offset = 0;
+
+/* SUNXI hardware write-1-to-clear registers emulation */
+int sunxi_hw_emulate_w1c = 0;
+
+/* SUNXI hardware IO window mapping */
+static void *sunxi_hw_mapping = NULL;
+static size_t sunxi_hw_mapping_size = 0;
+static volatile unsigned char *sunxi_hw_registers = NULL;
+static unsigned int sunxi_hw_map_count = 0;
+
+/* SUNXI hardware interfaces initialized with sunxi_hw_init, one interface reference held for all the calls */
+static unsigned int sunxi_hw_flags = 0;
+static unsigned int sunxi_hw_init_count = 0;
+static pthread_mutex_t sunxi_hw_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* SUNXI hardware mutex */
+static pthread_mutex_t sunxi_hw_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/****************************************************************************************/
+/* Exported functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Set device used to map the registers, to be called before initialization
+ * @param filename Device path, /dev/mem by default
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_hw_set_device(char *filename) {
+
+  int r = 0;
+
+  /* Check device path */
+  if ((filename == NULL) || (strlen(filename) >= sizeof(sunxi_hw_device))) {
+    return -EINVAL;
+  }
+
+  /* Set device, not possible while the registers are mapped */
+  pthread_mutex_lock(&sunxi_hw_mutex);
+  if (sunxi_hw_map_count != 0) {
+    r = -EBUSY;
+  } else {
+    strcpy(sunxi_hw_device, filename);
+  }
+  pthread_mutex_unlock(&sunxi_hw_mutex);
+
+  return r;
+}
+
+/**
+ * Set backend used to map the registers instead of the device, to be called before initialization
+ * The backend is a file descriptor (regular file, memfd, ...) laid out like the IO window starting at
+ * SUNXI_HW_IO_BASE, so that the library can run and be benchmarked without hardware.
+ * @param fd Backend file descriptor, duplicated, -1 to use the device again
+ * @param offset Offset of the IO window in the backend
+ * @param flags Backend flags, SUNXI_HW_BACKEND_EMULATE_W1C if writes have no side effects
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_hw_set_backend(int fd, unsigned long offset, unsigned int flags) {
+
+  int r = 0, dup_fd = -1;
+
+  /* Duplicate backend file descriptor */
+  if ((fd >= 0) && ((dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0)) {
+    return -errno;
+  }
+
+  /* Set backend, not possible while the registers are mapped */
+  pthread_mutex_lock(&sunxi_hw_mutex);
+  if (sunxi_hw_map_count != 0) {
+    r = -EBUSY;
+    if (dup_fd >= 0) close(dup_fd);
+  } else {
+    if (sunxi_hw_backend_fd >= 0) close(sunxi_hw_backend_fd);
+    sunxi_hw_backend_fd = dup_fd;
+    sunxi_hw_backend_offset = offset;
+    sunxi_hw_emulate_w1c = ((dup_fd >= 0) && (flags & SUNXI_HW_BACKEND_EMULATE_W1C)) ? 1 : 0;
+  }
+  pthread_mutex_unlock(&sunxi_hw_mutex);
+
+  return r;
+}
+
+/**
+ * Initialize hardware interfaces, the registers of all the interfaces share a single mapping
+ * Calls can be nested, each call must be balanced with a call to sunxi_hw_deinit. The interfaces
+ * also initialized with their own functions (sunxi_gpio_init, ...) stay initialized until these
+ * calls are balanced too.
+ * @param flags Expected interfaces, bitwise of SUNXI_HW_GPIO, SUNXI_HW_PWM and SUNXI_HW_LRADC
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_hw_init(unsigned int flags) {
+
+  unsigned int init;
+  int r = 0;
+
+  pthread_mutex_lock(&sunxi_hw_init_mutex);
+
+  /* Initialize interfaces not yet initialized by a previous call */
+  init = flags & ~sunxi_hw_flags;
+  if ((init & SUNXI_HW_GPIO) && ((r = sunxi_gpio_init()) < 0)) {
+    goto exit;
+  }
+  if ((init & SUNXI_HW_PWM) && ((r = sunxi_pwm_init()) < 0)) {
+    if (init & SUNXI_HW_GPIO) sunxi_gpio_deinit();
+    goto exit;
+  }
+  if ((init & SUNXI_HW_LRADC) && ((r = sunxi_lradc_init()) < 0)) {
+    if (init & SUNXI_HW_PWM) sunxi_pwm_deinit();
+    if (init & SUNXI_HW_GPIO) sunxi_gpio_deinit();
+    goto exit;
+  }
+  sunxi_hw_flags |= init;
+  sunxi_hw_init_count++;
+
+exit:
+  pthread_mutex_unlock(&sunxi_hw_init_mutex);
+  return r;
+}
+
+/**
+ * Release hardware interfaces, released when the last call to sunxi_hw_init is balanced
+ * The registers are unmapped when no more interface uses them.
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_hw_deinit() {
+
+  pthread_mutex_lock(&sunxi_hw_init_mutex);
+
+  /* Check if initialization has been performed */
+  if (sunxi_hw_init_count == 0) {
+    pthread_mutex_unlock(&sunxi_hw_init_mutex);
+    return -EPERM;
+  }
+
+  /* Release the interfaces references held by the calls */
+  if (--sunxi_hw_init_count == 0) {
+    if (sunxi_hw_flags & SUNXI_HW_LRADC) sunxi_lradc_deinit();
+    if (sunxi_hw_flags & SUNXI_HW_PWM) sunxi_pwm_deinit();
+    if (sunxi_hw_flags & SUNXI_HW_GPIO) sunxi_gpio_deinit();
+    sunxi_hw_flags = 0;
+  }
+
+  pthread_mutex_unlock(&sunxi_hw_init_mutex);
+  return 0;
+}
+
+/**
+ * Map the IO window, the device is opened once and the mapping is shared by all the interfaces
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_hw_map() {
+
+  int fd, r = 0;
+  unsigned long page_size, page_mask;
+  unsigned long addr_start, addr_offset;
+  void *pc;
+
+  pthread_mutex_lock(&sunxi_hw_mutex);
+
+  /* Map the IO window at first call only */
+  if (sunxi_hw_map_count == 0) {
+
+    /* Open device, or use backend */
+    if (sunxi_hw_backend_fd >= 0) {
+      fd = fcntl(sunxi_hw_backend_fd, F_DUPFD_CLOEXEC, 0);
+    } else {
+      fd = open(sunxi_hw_device, O_RDWR | O_CLOEXEC);
+    }
+    if (fd < 0) {
+      r = -errno;
+      goto exit;
+    }
+
+    /* Map to device */
+    page_size = sysconf(_SC_PAGESIZE);
+    page_mask = (~(page_size-1));
+    if (sunxi_hw_backend_fd >= 0) {
+      addr_start = sunxi_hw_backend_offset & page_mask;
+      addr_offset = sunxi_hw_backend_offset & ~page_mask;
+    } else {
+      addr_start = SUNXI_HW_IO_BASE & page_mask;
+      addr_offset = SUNXI_HW_IO_BASE & ~page_mask;
+    }
+    sunxi_hw_mapping_size = (((SUNXI_HW_IO_SIZE + addr_offset) + page_size - 1) / page_size) * page_size;
+    pc = mmap(NULL, sunxi_hw_mapping_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, addr_start);
+    if (pc == MAP_FAILED) {
+      r = -errno;
+      close(fd);
+      goto exit;
+    }
+
+    /* Retrieve registers address used later in this library */
+    sunxi_hw_mapping = pc;
+    sunxi_hw_registers = (volatile unsigned char *)pc + addr_offset;
+
+    /* Close device */
+    close(fd);
+  }
+  sunxi_hw_map_count++;
+
+exit:
+  pthread_mutex_unlock(&sunxi_hw_mutex);
+  return r;
+}
+
+/**
+ * Release the IO window, it is unmapped when the last user releases it
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_hw_unmap() {
+
+  int r = 0;
+
+  pthread_mutex_lock(&sunxi_hw_mutex);
+  if (sunxi_hw_map_count == 0) {
+    r = -EPERM;
+  } else if (--sunxi_hw_map_count == 0) {
+    if (munmap(sunxi_hw_mapping, sunxi_hw_mapping_size) < 0) {
+      r = -errno;
+    }
+    sunxi_hw_mapping = NULL;
+    sunxi_hw_registers = NULL;
+  }
+  pthread_mutex_unlock(&sunxi_hw_mutex);
+
+  return r;
+}
+
+/**
+ * Get address of registers in the IO window
+ * @param addr Physical address of the registers
+ * @param size Size of the registers
+ * @return Address of the registers if the IO window is mapped, NULL otherwise
+ */
+volatile void *sunxi_hw_address(unsigned long addr, unsigned long size) {
+
+  /* Check if the IO window is mapped and contains the registers */
+  if ((sunxi_hw_registers == NULL) || (addr < SUNXI_HW_IO_BASE) || (addr + size > SUNXI_HW_IO_BASE + SUNXI_HW_IO_SIZE)) {
+    return NULL;
+  }
+
+  return sunxi_hw_registers + (addr - SUNXI_HW_IO_BASE);
+}
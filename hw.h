@@ -0,0 +1,84 @@
+/****************************************************************************************/
+/* SUNXI hardware library interface                                                     */
+/****************************************************************************************/
+
+#ifndef SUNXI_HW_H_
+#define SUNXI_HW_H_
+
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* SUNXI hardware interfaces */
+#define SUNXI_HW_GPIO                           (1 << 0)
+#define SUNXI_HW_PWM                            (1 << 1)
+#define SUNXI_HW_LRADC                          (1 << 2)
+#define SUNXI_HW_ALL                            (SUNXI_HW_GPIO | SUNXI_HW_PWM | SUNXI_HW_LRADC)
+
+/* SUNXI hardware default device */
+#define SUNXI_HW_DEVICE                         "/dev/mem"
+
+/* SUNXI hardware backend flags */
+#define SUNXI_HW_BACKEND_EMULATE_W1C            (1 << 0)
+
+/* SUNXI hardware IO window, from CCU to LRADC registers */
+#define SUNXI_HW_IO_BASE                        0x01c20000
+#define SUNXI_HW_IO_SIZE                        0x3000
+
+
+/****************************************************************************************/
+/* Global variables                                                                     */
+/****************************************************************************************/
+
+/* SUNXI hardware write-1-to-clear registers emulation, set with SUNXI_HW_BACKEND_EMULATE_W1C */
+extern int sunxi_hw_emulate_w1c;
+
+
+/****************************************************************************************/
+/* Prototypes                                                                           */
+/****************************************************************************************/
+
+int sunxi_hw_set_device(char *filename);
+int sunxi_hw_set_backend(int fd, unsigned long offset, unsigned int flags);
+int sunxi_hw_init(unsigned int flags);
+int sunxi_hw_deinit();
+int sunxi_hw_map();
+int sunxi_hw_unmap();
+volatile void *sunxi_hw_address(unsigned long addr, unsigned long size);
+
+
+/****************************************************************************************/
+/* Inline functions                                                                     */
+/****************************************************************************************/
+
+/**
+ * Clear bits of a write-1-to-clear status register
+ * Backends without side effects on write (memory, files) emulate it with an atomic clear.
+ * @param reg Status register
+ * @param bits Bits to be cleared
+ */
+static inline void sunxi_hw_write1c(volatile unsigned int *reg, unsigned int bits) {
+
+  if (sunxi_hw_emulate_w1c)
+    __atomic_fetch_and(reg, ~bits, __ATOMIC_SEQ_CST);
+  else
+    *reg = bits;
+}
+
+
+#endif
@@ -0,0 +1,200 @@
+/****************************************************************************************/
+/* SUNXI lock library interface                                                         */
+/****************************************************************************************/
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include "lock.h"
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* Number of attempts before sleeping on a contended lock */
+#define SUNXI_LOCK_SPIN_COUNT                   100
+
+
+/****************************************************************************************/
+/* Global variables                                                                     */
+/****************************************************************************************/
+
+/* SUNXI locks, NULL if locking is disabled */
+struct sunxi_lock *sunxi_locks = NULL;
+
+/* SUNXI locks used with SUNXI_LOCK_MODE_THREAD */
+static struct sunxi_lock sunxi_lock_private[SUNXI_LOCK_COUNT];
+
+/* SUNXI lock mode */
+static unsigned int sunxi_lock_mode = SUNXI_LOCK_MODE_NONE;
+
+/* SUNXI lock process-unsafe users, SUNXI_LOCK_MODE_PROCESS cannot be selected while not zero */
+static unsigned int sunxi_lock_unsafe_users = 0;
+
+/* SUNXI lock mode mutex, the mode being checked and switched with the process-unsafe users held */
+static pthread_mutex_t sunxi_lock_mode_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* SUNXI lock futex operations, private operations are faster when locks are not shared */
+static int sunxi_lock_futex_wait = FUTEX_WAIT_PRIVATE;
+static int sunxi_lock_futex_wake = FUTEX_WAKE_PRIVATE;
+
+
+/****************************************************************************************/
+/* Exported functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Set lock mode, to be called before the interfaces are used concurrently
+ * With SUNXI_LOCK_MODE_PROCESS the locks are located in a shared memory object, so that the
+ * processes mapping the same registers coordinate. A process terminated while holding a lock
+ * blocks the others, locks are only held during a few register accesses. Process-unsafe users
+ * (e.g. GPIO shadow registers) must be released before selecting SUNXI_LOCK_MODE_PROCESS.
+ * @param mode Expected mode, SUNXI_LOCK_MODE_NONE, SUNXI_LOCK_MODE_THREAD or SUNXI_LOCK_MODE_PROCESS
+ * @return 0 if the function succeeds, -EBUSY if process-unsafe users remain, error code otherwise
+ */
+int sunxi_lock_set_mode(unsigned int mode) {
+
+  int fd, r;
+  void *pc;
+
+  /* Check mode */
+  if (mode > SUNXI_LOCK_MODE_PROCESS) {
+    return -EINVAL;
+  }
+
+  /* Check process-unsafe users, their state would not be shared with the other processes */
+  pthread_mutex_lock(&sunxi_lock_mode_mutex);
+  if ((mode == SUNXI_LOCK_MODE_PROCESS) && (sunxi_lock_mode != SUNXI_LOCK_MODE_PROCESS) && (sunxi_lock_unsafe_users > 0)) {
+    pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+    return -EBUSY;
+  }
+
+  /* Release shared memory of the previous mode */
+  if ((sunxi_lock_mode == SUNXI_LOCK_MODE_PROCESS) && (mode != SUNXI_LOCK_MODE_PROCESS)) {
+    munmap(sunxi_locks, sizeof(struct sunxi_lock) * SUNXI_LOCK_COUNT);
+  }
+
+  /* Set locks */
+  switch (mode) {
+    case SUNXI_LOCK_MODE_THREAD:
+      sunxi_locks = sunxi_lock_private;
+      sunxi_lock_futex_wait = FUTEX_WAIT_PRIVATE;
+      sunxi_lock_futex_wake = FUTEX_WAKE_PRIVATE;
+      break;
+    case SUNXI_LOCK_MODE_PROCESS:
+      if (sunxi_lock_mode == SUNXI_LOCK_MODE_PROCESS) {
+        pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+        return 0;
+      }
+      /* Open shared memory object, a zero filled object is a set of unlocked locks */
+      fd = shm_open(SUNXI_LOCK_SHM_NAME, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+      if (fd < 0) {
+        r = -errno;
+        pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+        return r;
+      }
+      if (ftruncate(fd, sizeof(struct sunxi_lock) * SUNXI_LOCK_COUNT) < 0) {
+        r = -errno;
+        close(fd);
+        pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+        return r;
+      }
+      pc = mmap(NULL, sizeof(struct sunxi_lock) * SUNXI_LOCK_COUNT, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if (pc == MAP_FAILED) {
+        r = -errno;
+        pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+        return r;
+      }
+      sunxi_locks = (struct sunxi_lock *)pc;
+      sunxi_lock_futex_wait = FUTEX_WAIT;
+      sunxi_lock_futex_wake = FUTEX_WAKE;
+      break;
+    default:
+      sunxi_locks = NULL;
+      break;
+  }
+  __atomic_store_n(&sunxi_lock_mode, mode, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+
+  return 0;
+}
+
+/**
+ * Get lock mode
+ * @return Lock mode, SUNXI_LOCK_MODE_NONE, SUNXI_LOCK_MODE_THREAD or SUNXI_LOCK_MODE_PROCESS
+ */
+int sunxi_lock_get_mode() {
+
+  return __atomic_load_n(&sunxi_lock_mode, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Register a process-unsafe user, a user keeping register state private to the process
+ * Each successful call must be balanced with a call to sunxi_lock_unsafe_put.
+ * @return 0 if the function succeeds, -EBUSY with SUNXI_LOCK_MODE_PROCESS
+ */
+int sunxi_lock_unsafe_get() {
+
+  /* Check lock mode, registers shared with other processes, the mode not switched meanwhile */
+  pthread_mutex_lock(&sunxi_lock_mode_mutex);
+  if (sunxi_lock_mode == SUNXI_LOCK_MODE_PROCESS) {
+    pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+    return -EBUSY;
+  }
+  sunxi_lock_unsafe_users++;
+  pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+
+  return 0;
+}
+
+/**
+ * Release a process-unsafe user registered with sunxi_lock_unsafe_get
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_lock_unsafe_put() {
+
+  /* Check if a user is registered */
+  pthread_mutex_lock(&sunxi_lock_mode_mutex);
+  if (sunxi_lock_unsafe_users == 0) {
+    pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+    return -EPERM;
+  }
+  sunxi_lock_unsafe_users--;
+  pthread_mutex_unlock(&sunxi_lock_mode_mutex);
+
+  return 0;
+}
+
+/**
+ * Acquire a contended lock, spin for a while then sleep on the futex
+ * @param lock Lock to be acquired
+ */
+void sunxi_lock_wait(struct sunxi_lock *lock) {
+
+  int c, spin;
+
+  /* Spin, the locks are held during a few register accesses only */
+  for (spin = 0; spin < SUNXI_LOCK_SPIN_COUNT; spin++) {
+    c = 0;
+    if (__atomic_compare_exchange_n(&lock->value, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+
+  /* Mark the lock contended and sleep until it is released */
+  while (__atomic_exchange_n(&lock->value, 2, __ATOMIC_ACQUIRE) != 0) {
+    syscall(SYS_futex, &lock->value, sunxi_lock_futex_wait, 2, NULL, NULL, 0);
+  }
+}
+
+/**
+ * Wake up a waiter of a released lock
+ * @param lock Lock released
+ */
+void sunxi_lock_wake(struct sunxi_lock *lock) {
+
+  syscall(SYS_futex, &lock->value, sunxi_lock_futex_wake, 1, NULL, NULL, 0);
+}
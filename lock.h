@@ -0,0 +1,108 @@
+/****************************************************************************************/
+/* SUNXI lock library interface                                                         */
+/****************************************************************************************/
+
+#ifndef SUNXI_LOCK_H_
+#define SUNXI_LOCK_H_
+
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* SUNXI lock modes */
+#define SUNXI_LOCK_MODE_NONE                    0
+#define SUNXI_LOCK_MODE_THREAD                  1
+#define SUNXI_LOCK_MODE_PROCESS                 2
+
+/* SUNXI locks, one per shared register group so that unrelated groups never contend */
+#define SUNXI_LOCK_GPIO_BANK(bank)              (bank)
+#define SUNXI_LOCK_GPIO_INT                     9
+#define SUNXI_LOCK_PWM                          10
+#define SUNXI_LOCK_LRADC                        11
+#define SUNXI_LOCK_COUNT                        12
+
+/* SUNXI lock shared memory object name, used with SUNXI_LOCK_MODE_PROCESS */
+#define SUNXI_LOCK_SHM_NAME                     "/libhwsunxi-lock"
+
+
+/****************************************************************************************/
+/* Types                                                                                */
+/****************************************************************************************/
+
+/* SUNXI lock, futex word alone in its cache line (0 unlocked, 1 locked, 2 locked with waiters) */
+struct sunxi_lock {
+  int value;
+  char res[60];
+} __attribute__((aligned(64)));
+
+
+/****************************************************************************************/
+/* Global variables                                                                     */
+/****************************************************************************************/
+
+/* SUNXI locks, NULL if locking is disabled */
+extern struct sunxi_lock *sunxi_locks;
+
+
+/****************************************************************************************/
+/* Prototypes                                                                           */
+/****************************************************************************************/
+
+int sunxi_lock_set_mode(unsigned int mode);
+int sunxi_lock_get_mode();
+int sunxi_lock_unsafe_get();
+int sunxi_lock_unsafe_put();
+void sunxi_lock_wait(struct sunxi_lock *lock);
+void sunxi_lock_wake(struct sunxi_lock *lock);
+
+
+/****************************************************************************************/
+/* Inline functions                                                                     */
+/****************************************************************************************/
+
+/**
+ * Acquire a lock, nothing is done if locking is disabled
+ * @param id Expected lock, see SUNXI_LOCK macros
+ * @return Lock to be given to sunxi_unlock
+ */
+static inline struct sunxi_lock *sunxi_lock(unsigned int id) {
+
+  struct sunxi_lock *lock;
+  int c = 0;
+
+  if (sunxi_locks == NULL) return NULL;
+  lock = &sunxi_locks[id];
+  if (!__atomic_compare_exchange_n(&lock->value, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    sunxi_lock_wait(lock);
+  return lock;
+}
+
+/**
+ * Release a lock
+ * @param lock Lock get from sunxi_lock
+ */
+static inline void sunxi_unlock(struct sunxi_lock *lock) {
+
+  if (lock == NULL) return;
+  if (__atomic_exchange_n(&lock->value, 0, __ATOMIC_RELEASE) == 2)
+    sunxi_lock_wake(lock);
+}
+
+
+#endif
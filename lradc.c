@@ -7,6 +7,8 @@
 /****************************************************************************************/
 
 #include "lradc.h"
+#include "hw.h"
+#include "lock.h"
 
 
 /****************************************************************************************/
@@ -27,6 +29,19 @@
 #define SUNXI_LRADC_SAMPLE_RATE(sample_rate)    (sample_rate << 2)
 #define SUNXI_LRADC_EN                          (1 << 0)
 
+/* Macros used for LRADC interrupts, same layout for control and status */
+#define SUNXI_LRADC_INT_DATA(ch)                (1 << (8 * (ch)))
+#define SUNXI_LRADC_INT_DATA_ALL                (SUNXI_LRADC_INT_DATA(0) | SUNXI_LRADC_INT_DATA(1))
+#define SUNXI_LRADC_INT_KEY(ch, type)           (1 << (8 * (ch) + 1 + (type)))
+#define SUNXI_LRADC_INT_KEY_ALL                 (0x1E | 0x1E00)
+
+/* Size of the key events queue */
+#define SUNXI_LRADC_EVENT_QUEUE_SIZE            64
+
+/* Sources handled by the LRADC monitor thread */
+#define SUNXI_LRADC_SOURCE_DATA                 (1 << 0)
+#define SUNXI_LRADC_SOURCE_KEYS                 (1 << 1)
+
 /* SUNXI LRADC Registers */
 struct sunxi_lradc_reg {
   volatile unsigned int ctrl;
@@ -35,6 +50,34 @@ struct sunxi_lradc_reg {
   volatile unsigned int data[2];
 };
 
+/* SUNXI LRADC acquisition ring slot, seq is the sample index + 1 once written, 0 while written */
+struct sunxi_lradc_slot {
+  __u64 seq;
+  __u64 timestamp_ns;
+  unsigned int channels;
+  unsigned int val[2];
+};
+
+/* SUNXI LRADC monitor, single thread acknowledging the interrupt status of all the sources, the
+   sources being started and stopped under the control mutex (never taken by the thread) */
+struct sunxi_lradc_monitor {
+  pthread_t thread;
+  pthread_mutex_t control;
+  pthread_mutex_t mutex;
+  volatile int running;
+  int uio;
+  unsigned int period_us;
+  unsigned int sources;
+  __u64 head;
+  struct sunxi_lradc_slot ring[SUNXI_LRADC_RING_SIZE];
+  int consumers[SUNXI_LRADC_CONSUMERS_MAX];
+  int efd;
+  struct sunxi_lradc_event queue[SUNXI_LRADC_EVENT_QUEUE_SIZE];
+  unsigned int head_event;
+  unsigned int count;
+  unsigned int lost;
+};
+
 
 /****************************************************************************************/
 /* Global variables                                                                     */
@@ -43,45 +86,346 @@ struct sunxi_lradc_reg {
 /* SUNXI LRADC registers */
 static volatile struct sunxi_lradc_reg *sunxi_lradc_registers = NULL;
 
+/* SUNXI LRADC interface users, the interface is released by the last one, counted under the init mutex */
+static unsigned int sunxi_lradc_init_count = 0;
+static pthread_mutex_t sunxi_lradc_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* SUNXI LRADC monitor, consumers and key events signaled by eventfd file descriptors */
+static struct sunxi_lradc_monitor sunxi_lradc_monitor = {
+  .control = PTHREAD_MUTEX_INITIALIZER,
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .uio = -1,
+  .efd = -1,
+  .consumers = { -1, -1, -1, -1, -1, -1, -1, -1 }
+};
+
+
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Push acquisition sample to the ring and signal the consumers, only called by the monitor thread
+ * The slot is marked as being written while updated, so that consumers detect overwritten samples.
+ * @param ints Data pending bits of the interrupt status
+ * @param timestamp Time of the sample
+ */
+static void sunxi_lradc_acquire_push(unsigned int ints, struct timespec *timestamp) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  struct sunxi_lradc_slot *slot;
+  __u64 head = monitor->head;
+  uint64_t one = 1;
+  unsigned int index;
+
+  /* Write the slot */
+  slot = &monitor->ring[head & (SUNXI_LRADC_RING_SIZE - 1)];
+  __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&slot->timestamp_ns, (__u64)timestamp->tv_sec * 1000000000ULL + timestamp->tv_nsec, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->channels, ((ints & SUNXI_LRADC_INT_DATA(0)) ? 1 : 0) | ((ints & SUNXI_LRADC_INT_DATA(1)) ? 2 : 0), __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->val[0], sunxi_lradc_registers->data[0], __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->val[1], sunxi_lradc_registers->data[1], __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+
+  /* Publish the sample and signal the consumers */
+  __atomic_store_n(&monitor->head, head + 1, __ATOMIC_RELEASE);
+  pthread_mutex_lock(&monitor->mutex);
+  for (index = 0; index < SUNXI_LRADC_CONSUMERS_MAX; index++) {
+    if (monitor->consumers[index] < 0) continue;
+    if (write(monitor->consumers[index], &one, sizeof(one)) != sizeof(one)) continue;
+  }
+  pthread_mutex_unlock(&monitor->mutex);
+}
+
+/**
+ * Push key events of the status to the queue
+ * The events of a channel are queued in the order key down, hold, already hold and key up.
+ * @param ints Key bits of the interrupt status
+ * @param timestamp Time of the events
+ */
+static void sunxi_lradc_event_push(unsigned int ints, struct timespec *timestamp) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  struct sunxi_lradc_event *event;
+  unsigned int ch, type;
+  uint64_t one = 1;
+
+  /* Check if monitoring is still started, the thread being shared with the acquisition */
+  pthread_mutex_lock(&monitor->mutex);
+  if (monitor->efd < 0) {
+    pthread_mutex_unlock(&monitor->mutex);
+    return;
+  }
+  for (ch = 0; ch < 2; ch++) {
+    for (type = SUNXI_LRADC_EVENT_KEYDOWN; type <= SUNXI_LRADC_EVENT_KEYUP; type++) {
+      if (!(ints & SUNXI_LRADC_INT_KEY(ch, type))) {
+        continue;
+      }
+
+      /* Drop the event if the queue is full, it is reported with the next one */
+      if (monitor->count == SUNXI_LRADC_EVENT_QUEUE_SIZE) {
+        monitor->lost++;
+        continue;
+      }
+
+      /* Queue the event and signal it */
+      event = &monitor->queue[(monitor->head_event + monitor->count) % SUNXI_LRADC_EVENT_QUEUE_SIZE];
+      event->ch = ch;
+      event->type = type;
+      event->val = sunxi_lradc_registers->data[ch];
+      event->lost = monitor->lost;
+      event->timestamp = *timestamp;
+      monitor->lost = 0;
+      monitor->count++;
+      if (write(monitor->efd, &one, sizeof(one)) != sizeof(one)) {
+        monitor->count--;
+        monitor->lost++;
+      }
+    }
+  }
+  pthread_mutex_unlock(&monitor->mutex);
+}
+
+/**
+ * LRADC monitor thread, the pending interrupts of the started sources are acknowledged and dispatched
+ * @param arg Not used
+ * @return Always NULL
+ */
+static void *sunxi_lradc_monitor_thread(void *arg) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  struct pollfd pfd;
+  struct timespec timestamp;
+  unsigned int ints, mask, sources;
+  uint32_t info;
+
+  (void)arg;
+
+  while (monitor->running) {
+
+    /* Wait for interrupt from the UIO device, or for the next polling period */
+    if (monitor->uio >= 0) {
+      pfd.fd = monitor->uio;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, 100) <= 0) continue;
+      if (read(monitor->uio, &info, sizeof(info)) != sizeof(info)) continue;
+    } else {
+      usleep(monitor->period_us);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &timestamp);
+
+    /* Acknowledge pending interrupts of the started sources */
+    sources = __atomic_load_n(&monitor->sources, __ATOMIC_ACQUIRE);
+    mask = 0;
+    if (sources & SUNXI_LRADC_SOURCE_DATA) {
+      mask |= SUNXI_LRADC_INT_DATA_ALL;
+    }
+    if (sources & SUNXI_LRADC_SOURCE_KEYS) {
+      mask |= SUNXI_LRADC_INT_KEY_ALL;
+    }
+    ints = sunxi_lradc_registers->ints & mask;
+    if (ints != 0) {
+      sunxi_hw_write1c(&sunxi_lradc_registers->ints, ints);
+    }
+
+    /* Dispatch the conversions */
+    if (ints & SUNXI_LRADC_INT_DATA_ALL) {
+      sunxi_lradc_acquire_push(ints & SUNXI_LRADC_INT_DATA_ALL, &timestamp);
+    }
+
+    /* Dispatch the key events */
+    if (ints & SUNXI_LRADC_INT_KEY_ALL) {
+      sunxi_lradc_event_push(ints & SUNXI_LRADC_INT_KEY_ALL, &timestamp);
+    }
+
+    /* Re-enable interrupt of the UIO device */
+    if (monitor->uio >= 0) {
+      info = 1;
+      if (write(monitor->uio, &info, sizeof(info)) != sizeof(info)) continue;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Start LRADC monitor thread for a source, the thread being shared by all the sources
+ * The UIO device and polling period of the first started source are used. Called with the control
+ * mutex held.
+ * @param source Source, SUNXI_LRADC_SOURCE macros
+ * @param ints Interrupts of the source
+ * @param uio /dev/uio* path of the LRADC interrupt, NULL to poll the interrupt status register
+ * @param period_us Polling period in us, not used with UIO device
+ * @return 0 if the function succeeds, error code otherwise
+ */
+static int sunxi_lradc_monitor_start(unsigned int source, unsigned int ints, char *uio, unsigned int period_us) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  struct sunxi_lock *lock;
+  int r;
+
+  /* Check if the source is already started */
+  if (monitor->sources & source) {
+    return -EBUSY;
+  }
+
+  /* Clear stale status and enable interrupts of the source */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
+  sunxi_hw_write1c(&sunxi_lradc_registers->ints, ints);
+  sunxi_lradc_registers->intc |= ints;
+  sunxi_unlock(lock);
+  __atomic_fetch_or(&monitor->sources, source, __ATOMIC_RELEASE);
+
+  /* Check if the thread is already started */
+  if (monitor->running) {
+    return 0;
+  }
+
+  /* Open UIO device */
+  if (uio != NULL) {
+    monitor->uio = open(uio, O_RDWR | O_CLOEXEC);
+    if (monitor->uio < 0) {
+      r = -errno;
+      goto error;
+    }
+  }
+
+  /* Start monitor thread */
+  monitor->period_us = period_us;
+  monitor->running = 1;
+  if ((r = pthread_create(&monitor->thread, NULL, sunxi_lradc_monitor_thread, NULL)) != 0) {
+    monitor->running = 0;
+    if (monitor->uio >= 0) close(monitor->uio);
+    monitor->uio = -1;
+    r = -r;
+    goto error;
+  }
+
+  return 0;
+
+error:
+  __atomic_fetch_and(&monitor->sources, ~source, __ATOMIC_RELEASE);
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
+  sunxi_lradc_registers->intc &= ~ints;
+  sunxi_unlock(lock);
+  return r;
+}
+
+/**
+ * Stop LRADC monitor thread for a source, the thread is stopped with the last source
+ * Called with the control mutex held.
+ * @param source Source, SUNXI_LRADC_SOURCE macros
+ * @param ints Interrupts of the source
+ * @return 0 if the function succeeds, error code otherwise
+ */
+static int sunxi_lradc_monitor_stop(unsigned int source, unsigned int ints) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  struct sunxi_lock *lock;
+
+  /* Check if the source is started */
+  if (!(monitor->sources & source)) {
+    return -EPERM;
+  }
+
+  /* Disable interrupts of the source */
+  __atomic_fetch_and(&monitor->sources, ~source, __ATOMIC_RELEASE);
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
+  sunxi_lradc_registers->intc &= ~ints;
+  sunxi_unlock(lock);
+
+  /* Stop monitor thread with the last source */
+  if (monitor->sources == 0) {
+    monitor->running = 0;
+    pthread_join(monitor->thread, NULL);
+    if (monitor->uio >= 0) close(monitor->uio);
+    monitor->uio = -1;
+  }
+
+  return 0;
+}
+
 
 /****************************************************************************************/
 /* Exported functions                                                                   */
 /****************************************************************************************/
 
 /**
- * Initialize LRADC interface, to be called once
+ * Initialize LRADC interface, the registers are mapped at first call
+ * Calls can be nested, each call must be balanced with a call to sunxi_lradc_deinit.
  * @return 0 if the function succeeds, error code otherwise
  */
 int sunxi_lradc_init() {
   
-  int fd;
-  unsigned int page_size, page_mask;
-  unsigned int addr_start, addr_offset;
-  void *pc;
-
-  /* Open device */
-  fd = open("/dev/mem", O_RDWR);
-  if (fd < 0) {
-    return -errno;
+  int r = 0;
+
+  pthread_mutex_lock(&sunxi_lradc_init_mutex);
+
+  /* Check if initialization has already been performed */
+  if (sunxi_lradc_registers != NULL) {
+    sunxi_lradc_init_count++;
+    goto exit;
   }
-  
+
   /* Map to device */
-  page_size = sysconf(_SC_PAGESIZE);
-  page_mask = (~(page_size-1));
-  addr_start = SUNXI_LRADC_IO_BASE & page_mask;
-  addr_offset = SUNXI_LRADC_IO_BASE & ~page_mask;
-  pc = mmap(NULL, (((sizeof(struct sunxi_lradc_reg) + addr_offset) / page_size) + 1) * page_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, addr_start);
-  if (pc == MAP_FAILED) {
-    return -errno;
+  if ((r = sunxi_hw_map()) < 0) {
+    goto exit;
   }
 
   /* Retrieve registers address used later in this library */
-  sunxi_lradc_registers = (struct sunxi_lradc_reg *)(pc + addr_offset);
-
-  /* Close device */
-  close(fd);
+  sunxi_lradc_registers = sunxi_hw_address(SUNXI_LRADC_IO_BASE, sizeof(struct sunxi_lradc_reg));
+  if (sunxi_lradc_registers == NULL) {
+    sunxi_hw_unmap();
+    r = -EFAULT;
+    goto exit;
+  }
   
-  return 0;
+  sunxi_lradc_init_count = 1;
+
+exit:
+  pthread_mutex_unlock(&sunxi_lradc_init_mutex);
+  return r;
+}
+
+/**
+ * Release LRADC interface, released when the last call to sunxi_lradc_init is balanced
+ * The registers are unmapped when no more interface uses them.
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_lradc_deinit() {
+
+  int r;
+
+  pthread_mutex_lock(&sunxi_lradc_init_mutex);
+
+  /* Check if initialization has been performed */
+  if (sunxi_lradc_registers == NULL) {
+    pthread_mutex_unlock(&sunxi_lradc_init_mutex);
+    return -EPERM;
+  }
+
+  /* Check if the interface is still used */
+  if (--sunxi_lradc_init_count > 0) {
+    pthread_mutex_unlock(&sunxi_lradc_init_mutex);
+    return 0;
+  }
+
+  /* Stop acquisition and key events monitoring */
+  if (sunxi_lradc_monitor.sources & SUNXI_LRADC_SOURCE_DATA) {
+    sunxi_lradc_acquire_stop();
+  }
+  if (sunxi_lradc_monitor.sources & SUNXI_LRADC_SOURCE_KEYS) {
+    sunxi_lradc_event_close();
+  }
+
+  /* Release registers */
+  sunxi_lradc_registers = NULL;
+
+  r = sunxi_hw_unmap();
+
+  pthread_mutex_unlock(&sunxi_lradc_init_mutex);
+  return r;
 }
 
 /**
@@ -91,14 +435,18 @@ int sunxi_lradc_init() {
  */
 int sunxi_lradc_set_first_convert_delay(unsigned int delay) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Set LRADC first convert delay */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   sunxi_lradc_registers->ctrl &= ~SUNXI_LRADC_FIRST_CONVERT_DELAY(255);
   sunxi_lradc_registers->ctrl |= SUNXI_LRADC_FIRST_CONVERT_DELAY(delay);
+  sunxi_unlock(lock);
   
   return 0;
 }
@@ -110,14 +458,18 @@ int sunxi_lradc_set_first_convert_delay(unsigned int delay) {
  */
 int sunxi_lradc_set_channel(unsigned int ch) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Set LRADC channel */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   sunxi_lradc_registers->ctrl &= ~SUNXI_LRADC_CHANNEL(3);
   sunxi_lradc_registers->ctrl |= SUNXI_LRADC_CHANNEL(ch);
+  sunxi_unlock(lock);
   
   return 0;
 }
@@ -129,14 +481,18 @@ int sunxi_lradc_set_channel(unsigned int ch) {
  */
 int sunxi_lradc_set_continue_time_select(unsigned int time) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Set LRADC continue time select */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   sunxi_lradc_registers->ctrl &= ~SUNXI_LRADC_CONTINUE_TIME_SELECT(15);
   sunxi_lradc_registers->ctrl |= SUNXI_LRADC_CONTINUE_TIME_SELECT(time);
+  sunxi_unlock(lock);
   
   return 0;
 }
@@ -148,14 +504,18 @@ int sunxi_lradc_set_continue_time_select(unsigned int time) {
  */
 int sunxi_lradc_set_key_mode(unsigned int key_mode) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Set LRADC key mode */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   sunxi_lradc_registers->ctrl &= ~SUNXI_LRADC_KEY_MODE(3);
   sunxi_lradc_registers->ctrl |= SUNXI_LRADC_KEY_MODE(key_mode);
+  sunxi_unlock(lock);
   
   return 0;
 }
@@ -167,14 +527,18 @@ int sunxi_lradc_set_key_mode(unsigned int key_mode) {
  */
 int sunxi_lradc_set_level_a_b_cnt(unsigned int cnt) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Set LRADC level A to level B cnt */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   sunxi_lradc_registers->ctrl &= ~SUNXI_LRADC_LEVEL_A_B_CNT(15);
   sunxi_lradc_registers->ctrl |= SUNXI_LRADC_LEVEL_A_B_CNT(cnt);
+  sunxi_unlock(lock);
   
   return 0;
 }
@@ -186,16 +550,20 @@ int sunxi_lradc_set_level_a_b_cnt(unsigned int cnt) {
  */
 int sunxi_lradc_set_hold_on(unsigned int hold_on) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Set LRADC hold on */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   if (hold_on == SUNXI_LRADC_HOLD_ON_DISABLE)
     sunxi_lradc_registers->ctrl &= ~SUNXI_LRADC_HOLD_ON;
   else
     sunxi_lradc_registers->ctrl |= SUNXI_LRADC_HOLD_ON;
+  sunxi_unlock(lock);
   
   return 0;
 }
@@ -207,14 +575,18 @@ int sunxi_lradc_set_hold_on(unsigned int hold_on) {
  */
 int sunxi_lradc_set_level_b_volt(unsigned int volt) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Set LRADC level B voltage */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   sunxi_lradc_registers->ctrl &= ~SUNXI_LRADC_LEVEL_B_VOLT(3);
   sunxi_lradc_registers->ctrl |= SUNXI_LRADC_LEVEL_B_VOLT(volt);
+  sunxi_unlock(lock);
   
   return 0;
 }
@@ -226,14 +598,18 @@ int sunxi_lradc_set_level_b_volt(unsigned int volt) {
  */
 int sunxi_lradc_set_sample_rate(unsigned int sample_rate) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Set LRADC sample rate */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   sunxi_lradc_registers->ctrl &= ~SUNXI_LRADC_SAMPLE_RATE(3);
   sunxi_lradc_registers->ctrl |= SUNXI_LRADC_SAMPLE_RATE(sample_rate);
+  sunxi_unlock(lock);
   
   return 0;
 }
@@ -263,13 +639,17 @@ int sunxi_lradc_read(unsigned int ch, unsigned int *val) {
  */
 int sunxi_lradc_enable() {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Enable LRADC */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   sunxi_lradc_registers->ctrl |= SUNXI_LRADC_EN;
+  sunxi_unlock(lock);
 
   return 0;
 }
@@ -280,13 +660,373 @@ int sunxi_lradc_enable() {
  */
 int sunxi_lradc_disable() {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_lradc_registers == NULL) {
     return -EPERM;
   }
 
   /* Disable LRADC */
+  lock = sunxi_lock(SUNXI_LOCK_LRADC);
   sunxi_lradc_registers->ctrl &= ~SUNXI_LRADC_EN;
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Start continuous acquisition, each conversion being pushed with its timestamp to a ring read
+ * by any number of consumers (see sunxi_lradc_consumer_open)
+ * The data pending interrupts are acknowledged by a monitor thread, woken up by the UIO device
+ * bound to the LRADC interrupt if available, or polling the interrupt status register otherwise.
+ * @param uio /dev/uio* path of the LRADC interrupt, NULL to poll the interrupt status register
+ * @param period_us Polling period in us, shorter than the sample period, not used with UIO device
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_lradc_acquire_start(char *uio, unsigned int period_us) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_lradc_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Start monitor thread */
+  pthread_mutex_lock(&monitor->control);
+  r = sunxi_lradc_monitor_start(SUNXI_LRADC_SOURCE_DATA, SUNXI_LRADC_INT_DATA_ALL, uio, period_us);
+  pthread_mutex_unlock(&monitor->control);
+
+  return r;
+}
+
+/**
+ * Stop continuous acquisition, the consumers can still read the samples of the ring
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_lradc_acquire_stop() {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_lradc_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Stop monitor thread if not used by the key events */
+  pthread_mutex_lock(&monitor->control);
+  r = sunxi_lradc_monitor_stop(SUNXI_LRADC_SOURCE_DATA, SUNXI_LRADC_INT_DATA_ALL);
+  pthread_mutex_unlock(&monitor->control);
+
+  return r;
+}
+
+/**
+ * Open acquisition consumer, reading the samples acquired from now on
+ * Each consumer reads every sample once, the samples overwritten before being read (more than
+ * SUNXI_LRADC_RING_SIZE behind) are counted in the overflows of the consumer.
+ * @param consumer Consumer
+ * @return File descriptor readable when samples are pending (poll/epoll) if the function succeeds, error code otherwise
+ */
+int sunxi_lradc_consumer_open(struct sunxi_lradc_consumer *consumer) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  int index, efd;
+
+  /* Open event file descriptor */
+  efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (efd < 0) {
+    return -errno;
+  }
+
+  /* Register consumer */
+  pthread_mutex_lock(&monitor->mutex);
+  for (index = 0; index < SUNXI_LRADC_CONSUMERS_MAX; index++) {
+    if (monitor->consumers[index] < 0) {
+      break;
+    }
+  }
+  if (index == SUNXI_LRADC_CONSUMERS_MAX) {
+    pthread_mutex_unlock(&monitor->mutex);
+    close(efd);
+    return -ENOSPC;
+  }
+  monitor->consumers[index] = efd;
+  consumer->id = index;
+  consumer->efd = efd;
+  consumer->cursor = __atomic_load_n(&monitor->head, __ATOMIC_ACQUIRE);
+  consumer->overflows = 0;
+  pthread_mutex_unlock(&monitor->mutex);
+
+  return efd;
+}
+
+/**
+ * Read acquisition sample, without blocking
+ * @param consumer Consumer
+ * @param sample Sample read
+ * @return 0 if the function succeeds, -EAGAIN if no sample is pending, error code otherwise
+ */
+int sunxi_lradc_consumer_read(struct sunxi_lradc_consumer *consumer, struct sunxi_lradc_sample *sample) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  struct sunxi_lradc_slot *slot;
+  __u64 head, seq, timestamp_ns;
+  unsigned int lost = 0;
+  uint64_t value;
+  int cleared = 0;
+
+  /* Check if consumer is opened */
+  if (consumer->efd < 0) {
+    return -EPERM;
+  }
+
+  while (1) {
+
+    /* Wait for a sample, the signal being cleared before checking again */
+    head = __atomic_load_n(&monitor->head, __ATOMIC_ACQUIRE);
+    if (consumer->cursor == head) {
+      if (cleared) {
+        return -EAGAIN;
+      }
+      if ((read(consumer->efd, &value, sizeof(value)) < 0) && (errno != EAGAIN)) {
+        return -errno;
+      }
+      cleared = 1;
+      continue;
+    }
+
+    /* Skip the overwritten samples */
+    if (head - consumer->cursor > SUNXI_LRADC_RING_SIZE) {
+      lost += head - consumer->cursor - SUNXI_LRADC_RING_SIZE;
+      consumer->cursor = head - SUNXI_LRADC_RING_SIZE;
+    }
+
+    /* Copy the slot, retried if written meanwhile */
+    slot = &monitor->ring[consumer->cursor & (SUNXI_LRADC_RING_SIZE - 1)];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != consumer->cursor + 1) {
+      continue;
+    }
+    timestamp_ns = __atomic_load_n(&slot->timestamp_ns, __ATOMIC_RELAXED);
+    sample->channels = __atomic_load_n(&slot->channels, __ATOMIC_RELAXED);
+    sample->val[0] = __atomic_load_n(&slot->val[0], __ATOMIC_RELAXED);
+    sample->val[1] = __atomic_load_n(&slot->val[1], __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    if (seq != consumer->cursor + 1) {
+      continue;
+    }
+    break;
+  }
+
+  sample->timestamp.tv_sec = timestamp_ns / 1000000000ULL;
+  sample->timestamp.tv_nsec = timestamp_ns % 1000000000ULL;
+  sample->lost = lost;
+  consumer->overflows += lost;
+  consumer->cursor++;
+
+  return 0;
+}
+
+/**
+ * Wait for acquisition sample
+ * @param consumer Consumer
+ * @param sample Sample read
+ * @param timeout_ms Timeout in ms, -1 to wait forever
+ * @return 0 if the function succeeds, -ETIMEDOUT if no sample is received, error code otherwise
+ */
+int sunxi_lradc_consumer_wait(struct sunxi_lradc_consumer *consumer, struct sunxi_lradc_sample *sample, int timeout_ms) {
+
+  struct pollfd pfd;
+  int r;
+
+  while ((r = sunxi_lradc_consumer_read(consumer, sample)) == -EAGAIN) {
+
+    /* Wait for sample */
+    pfd.fd = consumer->efd;
+    pfd.events = POLLIN;
+    if ((r = poll(&pfd, 1, timeout_ms)) < 0) {
+      return -errno;
+    }
+    if (r == 0) {
+      return -ETIMEDOUT;
+    }
+  }
+
+  return r;
+}
+
+/**
+ * Close acquisition consumer
+ * @param consumer Consumer
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_lradc_consumer_close(struct sunxi_lradc_consumer *consumer) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+
+  /* Check if consumer is opened */
+  if (consumer->efd < 0) {
+    return -EPERM;
+  }
+
+  /* Unregister consumer */
+  pthread_mutex_lock(&monitor->mutex);
+  monitor->consumers[consumer->id] = -1;
+  pthread_mutex_unlock(&monitor->mutex);
+  close(consumer->efd);
+  consumer->efd = -1;
+
+  return 0;
+}
+
+/**
+ * Start monitoring of the key events, key down, hold, already hold and key up of both channels
+ * The key interrupts are enabled and acknowledged by the monitor thread shared with the
+ * acquisition, woken up by the UIO device bound to the LRADC interrupt if available, or polling
+ * the interrupt status register otherwise (the UIO device and period of the acquisition are
+ * used if it is already started).
+ * @param uio /dev/uio* path of the LRADC interrupt, NULL to poll the interrupt status register
+ * @param period_us Polling period in us, not used with UIO device
+ * @return File descriptor readable when events are pending (poll/epoll) if the function succeeds, error code otherwise
+ */
+int sunxi_lradc_event_open(char *uio, unsigned int period_us) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  int efd, r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_lradc_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check if monitoring is already started */
+  pthread_mutex_lock(&monitor->control);
+  if (monitor->sources & SUNXI_LRADC_SOURCE_KEYS) {
+    pthread_mutex_unlock(&monitor->control);
+    return -EBUSY;
+  }
+
+  /* Open event file descriptor, one event is read at a time */
+  efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
+  if (efd < 0) {
+    r = -errno;
+    pthread_mutex_unlock(&monitor->control);
+    return r;
+  }
+
+  /* Reset the queue, the monitor thread may already be started by the acquisition */
+  pthread_mutex_lock(&monitor->mutex);
+  monitor->efd = efd;
+  monitor->head_event = 0;
+  monitor->count = 0;
+  monitor->lost = 0;
+  pthread_mutex_unlock(&monitor->mutex);
+
+  /* Start monitor thread */
+  if ((r = sunxi_lradc_monitor_start(SUNXI_LRADC_SOURCE_KEYS, SUNXI_LRADC_INT_KEY_ALL, uio, period_us)) < 0) {
+    pthread_mutex_lock(&monitor->mutex);
+    monitor->efd = -1;
+    pthread_mutex_unlock(&monitor->mutex);
+    close(efd);
+    pthread_mutex_unlock(&monitor->control);
+    return r;
+  }
+  pthread_mutex_unlock(&monitor->control);
+
+  return efd;
+}
+
+/**
+ * Read key event, without blocking
+ * @param event Event read
+ * @return 0 if the function succeeds, -EAGAIN if no event is pending, error code otherwise
+ */
+int sunxi_lradc_event_read(struct sunxi_lradc_event *event) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  uint64_t value;
+
+  /* Check if monitoring is started */
+  if (monitor->efd < 0) {
+    return -EPERM;
+  }
+
+  /* Consume one event signal */
+  if (read(monitor->efd, &value, sizeof(value)) != sizeof(value)) {
+    return -errno;
+  }
+
+  /* Retrieve event */
+  pthread_mutex_lock(&monitor->mutex);
+  *event = monitor->queue[monitor->head_event];
+  monitor->head_event = (monitor->head_event + 1) % SUNXI_LRADC_EVENT_QUEUE_SIZE;
+  monitor->count--;
+  pthread_mutex_unlock(&monitor->mutex);
+
+  return 0;
+}
+
+/**
+ * Wait for key event
+ * @param event Event read
+ * @param timeout_ms Timeout in ms, -1 to wait forever
+ * @return 0 if the function succeeds, -ETIMEDOUT if no event is received, error code otherwise
+ */
+int sunxi_lradc_event_wait(struct sunxi_lradc_event *event, int timeout_ms) {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  struct pollfd pfd;
+  int r;
+
+  /* Check if monitoring is started */
+  if (monitor->efd < 0) {
+    return -EPERM;
+  }
+
+  /* Wait for event */
+  pfd.fd = monitor->efd;
+  pfd.events = POLLIN;
+  if ((r = poll(&pfd, 1, timeout_ms)) < 0) {
+    return -errno;
+  }
+  if (r == 0) {
+    return -ETIMEDOUT;
+  }
+
+  return sunxi_lradc_event_read(event);
+}
+
+/**
+ * Stop monitoring of the key events, the key interrupts are disabled
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_lradc_event_close() {
+
+  struct sunxi_lradc_monitor *monitor = &sunxi_lradc_monitor;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_lradc_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Stop monitor thread if not used by the acquisition */
+  pthread_mutex_lock(&monitor->control);
+  if ((r = sunxi_lradc_monitor_stop(SUNXI_LRADC_SOURCE_KEYS, SUNXI_LRADC_INT_KEY_ALL)) < 0) {
+    pthread_mutex_unlock(&monitor->control);
+    return r;
+  }
+
+  /* Close event file descriptor */
+  pthread_mutex_lock(&monitor->mutex);
+  close(monitor->efd);
+  monitor->efd = -1;
+  pthread_mutex_unlock(&monitor->mutex);
+  pthread_mutex_unlock(&monitor->control);
 
   return 0;
 }
@@ -13,11 +13,17 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 #include <linux/types.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
 
 
 /****************************************************************************************/
@@ -50,12 +56,54 @@
 #define SUNXI_LRADC_SAMPLE_RATE_62_5HZ          2
 #define SUNXI_LRADC_SAMPLE_RATE_32_25HZ         3
 
+/* SUNXI LRADC key event types */
+#define SUNXI_LRADC_EVENT_KEYDOWN               0
+#define SUNXI_LRADC_EVENT_HOLD                  1
+#define SUNXI_LRADC_EVENT_ALREADY_HOLD          2
+#define SUNXI_LRADC_EVENT_KEYUP                 3
+
+/* SUNXI LRADC acquisition ring size (power of 2) and maximum number of consumers */
+#define SUNXI_LRADC_RING_SIZE                   256
+#define SUNXI_LRADC_CONSUMERS_MAX               8
+
+
+/****************************************************************************************/
+/* Types                                                                                */
+/****************************************************************************************/
+
+/* SUNXI LRADC acquisition sample, channels converted (bit 0 for CH0, bit 1 for CH1) and number
+   of samples lost by the consumer before this one */
+struct sunxi_lradc_sample {
+  struct timespec timestamp;
+  unsigned int channels;
+  unsigned int val[2];
+  unsigned int lost;
+};
+
+/* SUNXI LRADC key event, ADC value of the key and number of events lost before this one */
+struct sunxi_lradc_event {
+  unsigned int ch;
+  unsigned int type;
+  unsigned int val;
+  unsigned int lost;
+  struct timespec timestamp;
+};
+
+/* SUNXI LRADC acquisition consumer, reading all the samples at its own cursor */
+struct sunxi_lradc_consumer {
+  int id;
+  int efd;
+  __u64 cursor;
+  unsigned long long overflows;
+};
+
 
 /****************************************************************************************/
 /* Prototypes                                                                           */
 /****************************************************************************************/
 
 int sunxi_lradc_init();
+int sunxi_lradc_deinit();
 int sunxi_lradc_set_first_convert_delay(unsigned int delay);
 int sunxi_lradc_set_channel(unsigned int ch);
 int sunxi_lradc_set_continue_time_select(unsigned int time);
@@ -67,6 +115,16 @@ int sunxi_lradc_set_sample_rate(unsigned int sample_rate);
 int sunxi_lradc_read(unsigned int ch, unsigned int *val);
 int sunxi_lradc_enable();
 int sunxi_lradc_disable();
+int sunxi_lradc_acquire_start(char *uio, unsigned int period_us);
+int sunxi_lradc_acquire_stop();
+int sunxi_lradc_consumer_open(struct sunxi_lradc_consumer *consumer);
+int sunxi_lradc_consumer_read(struct sunxi_lradc_consumer *consumer, struct sunxi_lradc_sample *sample);
+int sunxi_lradc_consumer_wait(struct sunxi_lradc_consumer *consumer, struct sunxi_lradc_sample *sample, int timeout_ms);
+int sunxi_lradc_consumer_close(struct sunxi_lradc_consumer *consumer);
+int sunxi_lradc_event_open(char *uio, unsigned int period_us);
+int sunxi_lradc_event_read(struct sunxi_lradc_event *event);
+int sunxi_lradc_event_wait(struct sunxi_lradc_event *event, int timeout_ms);
+int sunxi_lradc_event_close();
 
 
 #endif
@@ -7,6 +7,8 @@
 /****************************************************************************************/
 
 #include "pwm.h"
+#include "hw.h"
+#include "lock.h"
 
 
 /****************************************************************************************/
@@ -21,6 +23,27 @@
 #define SUNXI_PWM_ACT_STATE(ch)                 ((1 << 5) << (15 * ch))
 #define SUNXI_PWM_CLK_GATING(ch)                ((1 << 6) << (15 * ch))
 #define SUNXI_PWM_PRESCALAR(ch, prescaler)      (prescaler << (15 * ch))
+#define SUNXI_PWM_RDY(ch)                       ((1 << 28) << (ch))
+
+/* SUNXI PWM period register ready polls before yielding the CPU */
+#define SUNXI_PWM_READY_SPINS                   100
+
+/* SUNXI PWM clock divider of each prescaler value, 0 if not valid */
+static const unsigned int sunxi_pwm_prescaler_table[] = {120, 180, 240, 360, 480, 0, 0, 0, 12000, 24000, 36000, 48000, 72000, 0, 0, 0};
+
+/* SUNXI PWM ramp engine, ch_period words precomputed for each channel and applied by a single thread,
+   a ramp ending when its channel configuration is applied again (applied count changed) */
+struct sunxi_pwm_ramp_engine {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int running;
+  unsigned int rate;
+  unsigned int *words[2];
+  unsigned int count[2];
+  unsigned int index[2];
+  unsigned int applied[2];
+};
 
 /* SUNXI PWM Registers */
 struct sunxi_pwm_reg {
@@ -36,45 +59,293 @@ struct sunxi_pwm_reg {
 /* SUNXI PWM registers */
 static volatile struct sunxi_pwm_reg *sunxi_pwm_registers = NULL;
 
+/* SUNXI PWM interface users, the interface is released by the last one, counted under the init mutex */
+static unsigned int sunxi_pwm_init_count = 0;
+static pthread_mutex_t sunxi_pwm_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* SUNXI PWM configuration applied to each channel and number of applies, PWM lock held */
+static struct sunxi_pwm_config sunxi_pwm_configs[2];
+static unsigned int sunxi_pwm_applied[2];
+
+/* SUNXI PWM ramp engine */
+static struct sunxi_pwm_ramp_engine sunxi_pwm_ramp_engine = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER
+};
+
+
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Compute PWM duty cycle in clock cycles, using the reciprocal of the compiled configuration
+ * @param config Compiled configuration
+ * @param duty_ns PWM duty cycle in ns
+ * @return Duty cycle in clock cycles, at most the period
+ */
+static inline unsigned int sunxi_pwm_duty_cycles(struct sunxi_pwm_config *config, __u64 duty_ns) {
+
+  __u64 dty, max = (config->cycles > 0xFFFF) ? 0xFFFF : config->cycles;
+
+  /* Duty cycle register is 16 bits wide */
+  if (duty_ns >= config->period_ns) {
+    return max;
+  }
+  dty = (duty_ns * config->scale + (1ULL << 39)) >> 40;
+  return (dty > max) ? max : dty;
+}
+
+/**
+ * Wait until PWM period registers can be written, the previous values being latched at the period
+ * boundary (A20, the ready bits always read 0 on A10), and take the PWM lock
+ * The ready bits are polled without the lock, which is only held for the stores, and checked again
+ * under the lock. The timeout covers the period running on the channels, which latches the pending
+ * value, and the period being written.
+ * @param mask Channels ready bits, bitwise of SUNXI_PWM_RDY(ch)
+ * @param period_ns Period being written, 0 if the period running is written again
+ * @param lock PWM lock, held if the function succeeds
+ * @return 0 if the function succeeds, error code otherwise
+ */
+static int sunxi_pwm_lock_ready(unsigned int mask, __u64 period_ns, struct sunxi_lock **lock) {
+
+  struct timespec start, now;
+  unsigned int ch, polls = 0;
+  __u64 timeout_ns;
+
+  *lock = sunxi_lock(SUNXI_LOCK_PWM);
+  while (sunxi_pwm_registers->ctrl & mask) {
+
+    /* Periods running on the channels, read under the lock */
+    for (ch = SUNXI_PWM_CH0; ch <= SUNXI_PWM_CH1; ch++) {
+      if ((mask & SUNXI_PWM_RDY(ch)) && (sunxi_pwm_configs[ch].period_ns > period_ns)) {
+        period_ns = sunxi_pwm_configs[ch].period_ns;
+      }
+    }
+    timeout_ns = 2 * period_ns + 1000000;
+    sunxi_unlock(*lock);
+
+    /* Poll without the lock, spinning first then yielding */
+    for (; sunxi_pwm_registers->ctrl & mask; polls++) {
+      if (polls < SUNXI_PWM_READY_SPINS) continue;
+      if (polls == SUNXI_PWM_READY_SPINS) clock_gettime(CLOCK_MONOTONIC, &start);
+      sched_yield();
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if ((__u64)((now.tv_sec - start.tv_sec) * 1000000000LL + now.tv_nsec - start.tv_nsec) > timeout_ns) {
+        return -EBUSY;
+      }
+    }
+    *lock = sunxi_lock(SUNXI_LOCK_PWM);
+  }
+  return 0;
+}
+
+
+/**
+ * Check if PWM channel ramp is in progress, ramp engine mutex held
+ * @param ch PWM channel
+ * @return 1 if the ramp is in progress, 0 otherwise
+ */
+static int sunxi_pwm_ramp_active(unsigned int ch) {
+
+  struct sunxi_pwm_ramp_engine *engine = &sunxi_pwm_ramp_engine;
+
+  return (engine->words[ch] != NULL) && (engine->index[ch] < engine->count[ch]);
+}
+
+/**
+ * PWM ramp engine thread, a step of each active ramp is applied at each absolute deadline,
+ * the thread sleeping while no ramp is in progress
+ * @param arg Unused
+ * @return NULL
+ */
+static void *sunxi_pwm_ramp_thread(void *arg) {
+
+  struct sunxi_pwm_ramp_engine *engine = &sunxi_pwm_ramp_engine;
+  struct timespec next, now;
+  long period_ns = 1000000000L / engine->rate;
+  struct sunxi_lock *lock;
+  unsigned int ch;
+
+  (void)arg;
+
+  pthread_mutex_lock(&engine->mutex);
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (engine->running) {
+
+    /* Sleep until a ramp starts */
+    if (!sunxi_pwm_ramp_active(SUNXI_PWM_CH0) && !sunxi_pwm_ramp_active(SUNXI_PWM_CH1)) {
+      pthread_cond_wait(&engine->cond, &engine->mutex);
+      clock_gettime(CLOCK_MONOTONIC, &next);
+      continue;
+    }
+    pthread_mutex_unlock(&engine->mutex);
+
+    /* Wait for next step, restart from now if late by more than a step instead of bursting */
+    next.tv_nsec += period_ns;
+    if (next.tv_nsec >= 1000000000L) {
+      next.tv_sec++;
+      next.tv_nsec -= 1000000000L;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec - next.tv_sec) * 1000000000LL + now.tv_nsec - next.tv_nsec > period_ns) {
+      next = now;
+    }
+
+    /* Apply steps, delayed to the next deadline if the period register is busy, the ramp ending if
+       the channel has been applied again since its start (words computed for another period) */
+    pthread_mutex_lock(&engine->mutex);
+    for (ch = SUNXI_PWM_CH0; ch <= SUNXI_PWM_CH1; ch++) {
+      if (!sunxi_pwm_ramp_active(ch)) continue;
+      lock = sunxi_lock(SUNXI_LOCK_PWM);
+      if (sunxi_pwm_applied[ch] != engine->applied[ch]) {
+        engine->index[ch] = engine->count[ch];
+      } else if (!(sunxi_pwm_registers->ctrl & SUNXI_PWM_RDY(ch))) {
+        sunxi_pwm_registers->ch_period[ch] = engine->words[ch][engine->index[ch]++];
+      }
+      sunxi_unlock(lock);
+      if (engine->index[ch] == engine->count[ch]) {
+        pthread_cond_broadcast(&engine->cond);
+      }
+    }
+  }
+  pthread_mutex_unlock(&engine->mutex);
+  return NULL;
+}
+
+/**
+ * Compute PWM ramp profile
+ * @param ramp Ramp
+ * @param t Position in the ramp, 0 to 1
+ * @return Profile value, 0 to 1
+ */
+static double sunxi_pwm_ramp_profile(struct sunxi_pwm_ramp *ramp, double t) {
+
+  double pos;
+  unsigned int k;
+
+  switch (ramp->profile) {
+    case SUNXI_PWM_RAMP_SCURVE:
+      return t * t * (3 - 2 * t);
+    case SUNXI_PWM_RAMP_GAMMA:
+      return pow(t, SUNXI_PWM_RAMP_GAMMA_VALUE);
+    case SUNXI_PWM_RAMP_TABLE:
+      pos = t * (ramp->table_len - 1);
+      k = (unsigned int)pos;
+      if (k >= ramp->table_len - 1) return (double)ramp->table[ramp->table_len - 1] / SUNXI_PWM_RAMP_TABLE_MAX;
+      return (ramp->table[k] + (ramp->table[k + 1] - (double)ramp->table[k]) * (pos - k)) / SUNXI_PWM_RAMP_TABLE_MAX;
+    default:
+      return t;
+  }
+}
+
+
+/**
+ * Write PWM servo period register words of both channels in the same period window
+ * @param servo Servo
+ * @param word0 Period register word of channel 0
+ * @param word1 Period register word of channel 1
+ * @return 0 if the function succeeds, error code otherwise
+ */
+static int sunxi_pwm_servo_write_sync(struct sunxi_pwm_servo *servo, unsigned int word0, unsigned int word1) {
+
+  struct sunxi_lock *lock;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_pwm_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Both registers ready, then back-to-back stores latched at the same period boundary */
+  if ((r = sunxi_pwm_lock_ready(SUNXI_PWM_RDY(SUNXI_PWM_CH0) | SUNXI_PWM_RDY(SUNXI_PWM_CH1), servo->config.period_ns, &lock)) < 0) {
+    return r;
+  }
+  sunxi_pwm_registers->ch_period[SUNXI_PWM_CH0] = word0;
+  sunxi_pwm_registers->ch_period[SUNXI_PWM_CH1] = word1;
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
 
 /****************************************************************************************/
 /* Exported functions                                                                   */
 /****************************************************************************************/
 
 /**
- * Initialize PWM interface, to be called once
+ * Initialize PWM interface, the registers are mapped at first call
+ * Calls can be nested, each call must be balanced with a call to sunxi_pwm_deinit.
  * @return 0 if the function succeeds, error code otherwise
  */
 int sunxi_pwm_init() {
   
-  int fd;
-  unsigned int page_size, page_mask;
-  unsigned int addr_start, addr_offset;
-  void *pc;
+  int r = 0;
 
-  /* Open device */
-  fd = open("/dev/mem", O_RDWR);
-  if (fd < 0) {
-    return -errno;
+  pthread_mutex_lock(&sunxi_pwm_init_mutex);
+
+  /* Check if initialization has already been performed */
+  if (sunxi_pwm_registers != NULL) {
+    sunxi_pwm_init_count++;
+    goto exit;
   }
-  
+
   /* Map to device */
-  page_size = sysconf(_SC_PAGESIZE);
-  page_mask = (~(page_size-1));
-  addr_start = SUNXI_PWM_IO_BASE & page_mask;
-  addr_offset = SUNXI_PWM_IO_BASE & ~page_mask;
-  pc = (void *)mmap(NULL, (((sizeof(struct sunxi_pwm_reg) + addr_offset) / page_size) + 1) * page_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, addr_start);
-  if (pc == MAP_FAILED) {
-    return -errno;
+  if ((r = sunxi_hw_map()) < 0) {
+    goto exit;
   }
 
   /* Retrieve registers address used later in this library */
-  sunxi_pwm_registers = (struct sunxi_pwm_reg *)(pc + addr_offset);
-
-  /* Close device */
-  close(fd);
+  sunxi_pwm_registers = sunxi_hw_address(SUNXI_PWM_IO_BASE, sizeof(struct sunxi_pwm_reg));
+  if (sunxi_pwm_registers == NULL) {
+    sunxi_hw_unmap();
+    r = -EFAULT;
+    goto exit;
+  }
   
-  return 0;
+  sunxi_pwm_init_count = 1;
+
+exit:
+  pthread_mutex_unlock(&sunxi_pwm_init_mutex);
+  return r;
+}
+
+/**
+ * Release PWM interface, released when the last call to sunxi_pwm_init is balanced
+ * The registers are unmapped when no more interface uses them.
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_deinit() {
+
+  int r;
+
+  pthread_mutex_lock(&sunxi_pwm_init_mutex);
+
+  /* Check if initialization has been performed */
+  if (sunxi_pwm_registers == NULL) {
+    pthread_mutex_unlock(&sunxi_pwm_init_mutex);
+    return -EPERM;
+  }
+
+  /* Check if the interface is still used */
+  if (--sunxi_pwm_init_count > 0) {
+    pthread_mutex_unlock(&sunxi_pwm_init_mutex);
+    return 0;
+  }
+
+  /* Stop ramp engine if started, its thread writes the registers */
+  sunxi_pwm_ramp_deinit();
+
+  /* Release registers */
+  sunxi_pwm_registers = NULL;
+  memset(sunxi_pwm_configs, 0, sizeof(sunxi_pwm_configs));
+  memset(sunxi_pwm_applied, 0, sizeof(sunxi_pwm_applied));
+
+  r = sunxi_hw_unmap();
+
+  pthread_mutex_unlock(&sunxi_pwm_init_mutex);
+  return r;
 }
 
 /**
@@ -85,16 +356,20 @@ int sunxi_pwm_init() {
  */
 int sunxi_pwm_set_polarity(unsigned int ch, unsigned int pol) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_pwm_registers == NULL) {
     return -EPERM;
   }
 
   /* Set PWM polarity */
+  lock = sunxi_lock(SUNXI_LOCK_PWM);
   if (pol == SUNXI_PWM_POLARITY_NORMAL)
     sunxi_pwm_registers->ctrl |= SUNXI_PWM_ACT_STATE(ch);
   else
     sunxi_pwm_registers->ctrl &= ~SUNXI_PWM_ACT_STATE(ch);
+  sunxi_unlock(lock);
 
   return 0;
 }
@@ -107,42 +382,214 @@ int sunxi_pwm_set_polarity(unsigned int ch, unsigned int pol) {
  * @return 0 if the function succeeds, error code otherwise
  */
 int sunxi_pwm_set_config(unsigned int ch, __u64 period_ns, __u64 duty_ns) {
-  
-  unsigned int prd, dty, clk_gating, prescaler = 0; __u64 div;
-  unsigned int prescaler_table[] = {120, 180, 240, 360, 480, 0, 0, 0, 12000, 24000, 36000, 48000, 72000, 0, 0, 0};
-    
+
+  struct sunxi_pwm_config config;
+  int r;
+
+  /* Solve and program PWM registers */
+  if ((r = sunxi_pwm_compile(ch, period_ns, &config)) < 0) {
+    return r;
+  }
+  return sunxi_pwm_apply(&config, duty_ns);
+}
+
+/**
+ * Compile PWM channel configuration, the prescaler giving the highest duty cycle resolution (most
+ * cycles per period) is selected, the most accurate one among equal resolutions, the period error
+ * being reported in the configuration
+ * @param ch PWM channel, SUNXI_PWM_CH0 or SUNXI_PWM_CH1
+ * @param period_ns PWM period in ns
+ * @param config Compiled configuration, with the actual period and its error
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_compile(unsigned int ch, __u64 period_ns, struct sunxi_pwm_config *config) {
+
+  unsigned int prescaler, found = 0;
+  __u64 div, cycles, actual_ns, error_ns, best_error_ns = 0;
+
+  /* Longest period is about 196s (72000 prescaler), checked to avoid overflows */
+  if ((ch > SUNXI_PWM_CH1) || (period_ns == 0) || (period_ns > 1000000000000ULL)) {
+    return -EINVAL;
+  }
+
+  /* Round the period to the nearest count of each prescaler */
+  for (prescaler = 0; prescaler <= 0x0F; prescaler++) {
+    if (!sunxi_pwm_prescaler_table[prescaler]) continue;
+    div = sunxi_pwm_prescaler_table[prescaler] * 1000000ULL;
+    cycles = (period_ns * (SUNXI_PWM_CLOCK / 1000) + div / 2) / div;
+    if ((cycles == 0) || (cycles > SUNXI_PWM_CYCLES_MAX)) continue;
+    actual_ns = cycles * div / (SUNXI_PWM_CLOCK / 1000);
+    error_ns = (actual_ns > period_ns) ? actual_ns - period_ns : period_ns - actual_ns;
+    if (!found || (cycles > config->cycles) || ((cycles == config->cycles) && (error_ns < best_error_ns))) {
+      config->ch = ch;
+      config->prescaler = prescaler;
+      config->cycles = cycles;
+      config->period_ns = actual_ns;
+      config->error_ns = (__s64)actual_ns - (__s64)period_ns;
+      best_error_ns = error_ns;
+      found = 1;
+    }
+  }
+  if (!found) {
+    return -EINVAL;
+  }
+
+  /* Clock cycles per ns, 40 fractional bits (duty_ns * scale fits in 64 bits as duty_ns < period_ns) */
+  config->scale = ((__u64)(SUNXI_PWM_CLOCK / 1000) << 40) / (sunxi_pwm_prescaler_table[config->prescaler] * 1000000ULL);
+
+  return 0;
+}
+
+/**
+ * Program PWM channel with a compiled configuration
+ * The control register is written only if the prescaler changes (clock gated meanwhile), otherwise
+ * only the period register is written, glitch free.
+ * @param config Compiled configuration
+ * @param duty_ns PWM duty cycle in ns
+ * @return 0 if the function succeeds, -EINVAL if the configuration is not compiled, error code otherwise
+ */
+int sunxi_pwm_apply(struct sunxi_pwm_config *config, __u64 duty_ns) {
+
+  unsigned int ch = config->ch, ctrl, clk_gating;
+  struct sunxi_lock *lock;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_pwm_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Check configuration, ch indexes the period registers and cycles - 1 is stored */
+  if ((config->ch > SUNXI_PWM_CH1) || (config->cycles == 0)) {
+    return -EINVAL;
+  }
+
+  /* Set PWM prescaler, period and duty cycle */
+  if ((r = sunxi_pwm_lock_ready(SUNXI_PWM_RDY(ch), config->period_ns, &lock)) < 0) {
+    return r;
+  }
+  ctrl = sunxi_pwm_registers->ctrl;
+  clk_gating = ctrl & SUNXI_PWM_CLK_GATING(ch);
+  if ((ctrl & SUNXI_PWM_PRESCALAR(ch, 0x0F)) != SUNXI_PWM_PRESCALAR(ch, config->prescaler)) {
+    ctrl &= ~SUNXI_PWM_CLK_GATING(ch);
+    if (clk_gating != 0) sunxi_pwm_registers->ctrl = ctrl;
+    ctrl = (ctrl & ~SUNXI_PWM_PRESCALAR(ch, 0x0F)) | SUNXI_PWM_PRESCALAR(ch, config->prescaler);
+    sunxi_pwm_registers->ctrl = ctrl;
+    sunxi_pwm_registers->ch_period[ch] = ((config->cycles - 1) << 16) + (sunxi_pwm_duty_cycles(config, duty_ns) & 0xFFFF);
+    if (clk_gating != 0) sunxi_pwm_registers->ctrl = ctrl | clk_gating;
+  } else {
+    sunxi_pwm_registers->ch_period[ch] = ((config->cycles - 1) << 16) + (sunxi_pwm_duty_cycles(config, duty_ns) & 0xFFFF);
+  }
+  sunxi_pwm_configs[ch] = *config;
+  sunxi_pwm_applied[ch]++;
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Update PWM channel duty cycle, only the period register is written
+ * The channel must have been programmed with the same compiled configuration (sunxi_pwm_apply).
+ * @param config Compiled configuration
+ * @param duty_ns PWM duty cycle in ns
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_write_duty(struct sunxi_pwm_config *config, __u64 duty_ns) {
+
+  struct sunxi_lock *lock;
+  int r;
+
   /* Check if initialization has been performed */
   if (sunxi_pwm_registers == NULL) {
     return -EPERM;
   }
 
-  /* Compute PWM registers */
-  for (prescaler = 0; prescaler < 0x0F; prescaler++) {
-    if (!prescaler_table[prescaler]) continue;
-    div = 24000000;
-    div = div / prescaler_table[prescaler];
-    div = div * period_ns;
-    div = div / 1000000000;
-    if (div - 1 <= 0xFFFF) break;
+  /* Check channel and configuration */
+  if ((config->ch > SUNXI_PWM_CH1) || (config->cycles == 0)) {
+    return -EINVAL;
+  }
+
+  /* Single store, no read-modify-write of the control register */
+  if ((r = sunxi_pwm_lock_ready(SUNXI_PWM_RDY(config->ch), config->period_ns, &lock)) < 0) {
+    return r;
+  }
+  sunxi_pwm_registers->ch_period[config->ch] = ((config->cycles - 1) << 16) + (sunxi_pwm_duty_cycles(config, duty_ns) & 0xFFFF);
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Update PWM channel duty cycle, with the period programmed by the last sunxi_pwm_set_config or
+ * sunxi_pwm_apply call, only the period register is written
+ * @param ch PWM channel, SUNXI_PWM_CH0 or SUNXI_PWM_CH1
+ * @param duty_ns PWM duty cycle in ns
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_set_duty(unsigned int ch, __u64 duty_ns) {
+
+  struct sunxi_pwm_config *config;
+  struct sunxi_lock *lock;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_pwm_registers == NULL) {
+    return -EPERM;
   }
-  if (div - 1 > 0xFFFF) {
+
+  /* Check channel */
+  if (ch > SUNXI_PWM_CH1) {
     return -EINVAL;
   }
-  prd = div;
-  div *= duty_ns;
-  div = div / period_ns;
-  dty = div;
-  
-  /* Set PWM period and duty cycle */
-  clk_gating = sunxi_pwm_registers->ctrl & SUNXI_PWM_CLK_GATING(ch);
-  sunxi_pwm_registers->ctrl &= ~SUNXI_PWM_CLK_GATING(ch);
-  sunxi_pwm_registers->ctrl &= ~SUNXI_PWM_PRESCALAR(ch, 0x0F);
-  sunxi_pwm_registers->ctrl |= SUNXI_PWM_PRESCALAR(ch, prescaler);
-  sunxi_pwm_registers->ch_period[ch] = ((prd - 1) << 16) + (dty & 0xFFFF);
-  if (clk_gating != 0) sunxi_pwm_registers->ctrl |= SUNXI_PWM_CLK_GATING(ch);
-  
+
+  /* Single store with the configuration applied on the channel, read under the lock it is written
+     with, so that a period applied meanwhile is not overwritten */
+  if ((r = sunxi_pwm_lock_ready(SUNXI_PWM_RDY(ch), 0, &lock)) < 0) {
+    return r;
+  }
+  config = &sunxi_pwm_configs[ch];
+  if (config->cycles == 0) {
+    sunxi_unlock(lock);
+    return -EINVAL;
+  }
+  sunxi_pwm_registers->ch_period[ch] = ((config->cycles - 1) << 16) + (sunxi_pwm_duty_cycles(config, duty_ns) & 0xFFFF);
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Set state of both PWM channels with a single store of the control register
+ * @param ch0_state State of channel 0, bitwise of SUNXI_PWM_STATE_ENABLE and SUNXI_PWM_STATE_INVERSED
+ * @param ch1_state State of channel 1, bitwise of SUNXI_PWM_STATE_ENABLE and SUNXI_PWM_STATE_INVERSED
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_set_channels(unsigned int ch0_state, unsigned int ch1_state) {
+
+  unsigned int ch, state, ctrl, mask = 0, val = 0;
+  struct sunxi_lock *lock;
+
+  /* Check if initialization has been performed */
+  if (sunxi_pwm_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Compute channels bits */
+  for (ch = SUNXI_PWM_CH0; ch <= SUNXI_PWM_CH1; ch++) {
+    state = (ch == SUNXI_PWM_CH0) ? ch0_state : ch1_state;
+    mask |= SUNXI_PWM_EN(ch) | SUNXI_PWM_CLK_GATING(ch) | SUNXI_PWM_ACT_STATE(ch);
+    if (state & SUNXI_PWM_STATE_ENABLE) val |= SUNXI_PWM_EN(ch) | SUNXI_PWM_CLK_GATING(ch);
+    if (!(state & SUNXI_PWM_STATE_INVERSED)) val |= SUNXI_PWM_ACT_STATE(ch);
+  }
+
+  /* Set PWM channels */
+  lock = sunxi_lock(SUNXI_LOCK_PWM);
+  ctrl = sunxi_pwm_registers->ctrl;
+  sunxi_pwm_registers->ctrl = (ctrl & ~mask) | val;
+  sunxi_unlock(lock);
+
   return 0;
-} 
+}
 
 /**
  * Enable PWM
@@ -151,14 +598,17 @@ int sunxi_pwm_set_config(unsigned int ch, __u64 period_ns, __u64 duty_ns) {
  */
 int sunxi_pwm_enable(unsigned int ch) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_pwm_registers == NULL) {
     return -EPERM;
   }
 
   /* Enable PWM */
-  sunxi_pwm_registers->ctrl |= SUNXI_PWM_EN(ch);
-  sunxi_pwm_registers->ctrl |= SUNXI_PWM_CLK_GATING(ch);
+  lock = sunxi_lock(SUNXI_LOCK_PWM);
+  sunxi_pwm_registers->ctrl |= SUNXI_PWM_EN(ch) | SUNXI_PWM_CLK_GATING(ch);
+  sunxi_unlock(lock);
 
   return 0;
 }
@@ -170,14 +620,414 @@ int sunxi_pwm_enable(unsigned int ch) {
  */
 int sunxi_pwm_disable(unsigned int ch) {
   
+  struct sunxi_lock *lock;
+
   /* Check if initialization has been performed */
   if (sunxi_pwm_registers == NULL) {
     return -EPERM;
   }
 
   /* Disable PWM */
-  sunxi_pwm_registers->ctrl &= ~SUNXI_PWM_EN(ch);
-  sunxi_pwm_registers->ctrl &= ~SUNXI_PWM_CLK_GATING(ch);
+  lock = sunxi_lock(SUNXI_LOCK_PWM);
+  sunxi_pwm_registers->ctrl &= ~(SUNXI_PWM_EN(ch) | SUNXI_PWM_CLK_GATING(ch));
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Start PWM ramp engine, a single thread applying the ramps of both channels
+ * The engine is started once, further calls return -EBUSY until sunxi_pwm_ramp_deinit.
+ * @param rate Ramp steps per second
+ * @param priority SCHED_FIFO priority of the thread, 0 for a normal thread (also used if not permitted)
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_ramp_init(unsigned int rate, int priority) {
+
+  struct sunxi_pwm_ramp_engine *engine = &sunxi_pwm_ramp_engine;
+  struct sched_param param;
+  pthread_attr_t attr;
+  int r = EPERM;
+
+  if ((rate == 0) || (rate > 1000000)) {
+    return -EINVAL;
+  }
+
+  /* Check if initialization has already been performed, the thread being created under the mutex so
+     that it is started before being seen running */
+  pthread_mutex_lock(&engine->mutex);
+  if (engine->running) {
+    pthread_mutex_unlock(&engine->mutex);
+    return -EBUSY;
+  }
+  engine->rate = rate;
+  engine->running = 1;
+
+  /* Start real-time thread, normal thread if not permitted */
+  if (priority > 0) {
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    param.sched_priority = priority;
+    pthread_attr_setschedparam(&attr, &param);
+    r = pthread_create(&engine->thread, &attr, sunxi_pwm_ramp_thread, NULL);
+    pthread_attr_destroy(&attr);
+  }
+  if (r == EPERM) {
+    r = pthread_create(&engine->thread, NULL, sunxi_pwm_ramp_thread, NULL);
+  }
+  if (r != 0) {
+    engine->running = 0;
+    pthread_mutex_unlock(&engine->mutex);
+    return -r;
+  }
+  pthread_mutex_unlock(&engine->mutex);
+
+  return 0;
+}
+
+/**
+ * Start PWM channel ramp, the steps are computed for the period programmed on the channel
+ * A ramp in progress on the channel is replaced, the ramp ends if the channel is programmed again
+ * (sunxi_pwm_set_config or sunxi_pwm_apply).
+ * @param ch PWM channel, SUNXI_PWM_CH0 or SUNXI_PWM_CH1
+ * @param ramp Ramp
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_ramp_start(unsigned int ch, struct sunxi_pwm_ramp *ramp) {
+
+  struct sunxi_pwm_ramp_engine *engine = &sunxi_pwm_ramp_engine;
+  struct sunxi_pwm_config config;
+  struct sunxi_lock *lock;
+  unsigned int step, steps, applied, rate, *words;
+  double duty_ns;
+
+  /* Check if initialization has been performed */
+  if (sunxi_pwm_registers == NULL) {
+    return -EPERM;
+  }
+  pthread_mutex_lock(&engine->mutex);
+  rate = engine->running ? engine->rate : 0;
+  pthread_mutex_unlock(&engine->mutex);
+  if (rate == 0) {
+    return -EPERM;
+  }
+  if ((ch > SUNXI_PWM_CH1) || (ramp->profile > SUNXI_PWM_RAMP_TABLE)) {
+    return -EINVAL;
+  }
+  if ((ramp->profile == SUNXI_PWM_RAMP_TABLE) && ((ramp->table == NULL) || (ramp->table_len < 2))) {
+    return -EINVAL;
+  }
+
+  /* Configuration applied on the channel */
+  lock = sunxi_lock(SUNXI_LOCK_PWM);
+  config = sunxi_pwm_configs[ch];
+  applied = sunxi_pwm_applied[ch];
+  sunxi_unlock(lock);
+  if (config.cycles == 0) {
+    return -EINVAL;
+  }
+
+  /* Precompute period register words */
+  steps = (unsigned long long)ramp->duration_ms * rate / 1000;
+  if (steps == 0) steps = 1;
+  if ((words = malloc(sizeof(unsigned int) * steps)) == NULL) {
+    return -ENOMEM;
+  }
+  for (step = 0; step < steps; step++) {
+    duty_ns = ramp->from_ns + ((double)ramp->to_ns - (double)ramp->from_ns) * sunxi_pwm_ramp_profile(ramp, (double)(step + 1) / steps);
+    words[step] = ((config.cycles - 1) << 16) + (sunxi_pwm_duty_cycles(&config, (__u64)(duty_ns + 0.5)) & 0xFFFF);
+  }
+
+  /* Hand over the ramp to the engine, unless stopped or restarted with another rate meanwhile */
+  pthread_mutex_lock(&engine->mutex);
+  if (!engine->running || (engine->rate != rate)) {
+    pthread_mutex_unlock(&engine->mutex);
+    free(words);
+    return -EPERM;
+  }
+  free(engine->words[ch]);
+  engine->words[ch] = words;
+  engine->count[ch] = steps;
+  engine->index[ch] = 0;
+  engine->applied[ch] = applied;
+  pthread_cond_broadcast(&engine->cond);
+  pthread_mutex_unlock(&engine->mutex);
+
+  return 0;
+}
+
+/**
+ * Wait for the end of PWM channel ramp
+ * @param ch PWM channel, SUNXI_PWM_CH0 or SUNXI_PWM_CH1
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_ramp_wait(unsigned int ch) {
+
+  struct sunxi_pwm_ramp_engine *engine = &sunxi_pwm_ramp_engine;
+
+  if (ch > SUNXI_PWM_CH1) {
+    return -EINVAL;
+  }
+  pthread_mutex_lock(&engine->mutex);
+  while (engine->running && sunxi_pwm_ramp_active(ch)) {
+    pthread_cond_wait(&engine->cond, &engine->mutex);
+  }
+  pthread_mutex_unlock(&engine->mutex);
+
+  return 0;
+}
+
+/**
+ * Stop PWM channel ramp, the duty cycle stays at the last step applied
+ * @param ch PWM channel, SUNXI_PWM_CH0 or SUNXI_PWM_CH1
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_ramp_stop(unsigned int ch) {
+
+  struct sunxi_pwm_ramp_engine *engine = &sunxi_pwm_ramp_engine;
+
+  if (ch > SUNXI_PWM_CH1) {
+    return -EINVAL;
+  }
+  pthread_mutex_lock(&engine->mutex);
+  free(engine->words[ch]);
+  engine->words[ch] = NULL;
+  engine->count[ch] = 0;
+  engine->index[ch] = 0;
+  pthread_cond_broadcast(&engine->cond);
+  pthread_mutex_unlock(&engine->mutex);
+
+  return 0;
+}
+
+/**
+ * Stop PWM ramp engine, the ramps in progress are stopped
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_ramp_deinit() {
+
+  struct sunxi_pwm_ramp_engine *engine = &sunxi_pwm_ramp_engine;
+  pthread_t thread;
+
+  /* Check if initialization has been performed */
+  pthread_mutex_lock(&engine->mutex);
+  if (!engine->running) {
+    pthread_mutex_unlock(&engine->mutex);
+    return -EPERM;
+  }
+
+  /* Stop thread */
+  engine->running = 0;
+  thread = engine->thread;
+  pthread_cond_broadcast(&engine->cond);
+  pthread_mutex_unlock(&engine->mutex);
+  pthread_join(thread, NULL);
+  sunxi_pwm_ramp_stop(SUNXI_PWM_CH0);
+  sunxi_pwm_ramp_stop(SUNXI_PWM_CH1);
+
+  return 0;
+}
+
+/**
+ * Initialize PWM servo, the period is solved once and the period register words are precomputed
+ * for each pulse width and each angle (tenth of degree, min_us at 0 and max_us at range_deg)
+ * @param servo Servo
+ * @param period_us Servo period in us, 20000 for 50Hz servos
+ * @param min_us Shortest pulse width in us
+ * @param max_us Longest pulse width in us
+ * @param range_deg Angle range in degrees, 0 if angles are not used
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_servo_init(struct sunxi_pwm_servo *servo, unsigned int period_us, unsigned int min_us, unsigned int max_us, unsigned int range_deg) {
+
+  unsigned int index;
+  int r;
+
+  if ((min_us > max_us) || (max_us > period_us)) {
+    return -EINVAL;
+  }
+  memset(servo, 0, sizeof(struct sunxi_pwm_servo));
+  if ((r = sunxi_pwm_compile(SUNXI_PWM_CH0, (__u64)period_us * 1000, &servo->config)) < 0) {
+    return r;
+  }
+  servo->min_us = min_us;
+  servo->max_us = max_us;
+  servo->range_ddeg = range_deg * 10;
+
+  /* Achievable resolution, one clock cycle */
+  servo->resolution_ns = servo->config.period_ns / servo->config.cycles;
+
+  /* Period register words */
+  servo->pulse_words = malloc(sizeof(unsigned int) * (max_us - min_us + 1));
+  servo->angle_words = malloc(sizeof(unsigned int) * (servo->range_ddeg + 1));
+  if ((servo->pulse_words == NULL) || (servo->angle_words == NULL)) {
+    sunxi_pwm_servo_deinit(servo);
+    return -ENOMEM;
+  }
+  for (index = 0; index <= max_us - min_us; index++) {
+    servo->pulse_words[index] = ((servo->config.cycles - 1) << 16) + (sunxi_pwm_duty_cycles(&servo->config, (__u64)(min_us + index) * 1000) & 0xFFFF);
+  }
+  for (index = 0; index <= servo->range_ddeg; index++) {
+    servo->angle_words[index] = (servo->range_ddeg == 0) ? servo->pulse_words[0] :
+      ((servo->config.cycles - 1) << 16) + (sunxi_pwm_duty_cycles(&servo->config, (__u64)min_us * 1000 + (__u64)(max_us - min_us) * 1000 * index / servo->range_ddeg) & 0xFFFF);
+  }
+
+  return 0;
+}
+
+/**
+ * Enable PWM servo channels, programmed with the servo period and the middle pulse width, the
+ * channels being enabled with a single store so that their periods are aligned
+ * @param servo Servo
+ * @param channels Servo channels, bitwise of SUNXI_PWM_SERVO_CH0 and SUNXI_PWM_SERVO_CH1
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_servo_enable(struct sunxi_pwm_servo *servo, unsigned int channels) {
+
+  struct sunxi_pwm_config config = servo->config;
+  unsigned int ch, val = 0;
+  struct sunxi_lock *lock;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_pwm_registers == NULL) {
+    return -EPERM;
+  }
+
+  /* Program channels */
+  for (ch = SUNXI_PWM_CH0; ch <= SUNXI_PWM_CH1; ch++) {
+    if (!(channels & (1 << ch))) continue;
+    config.ch = ch;
+    if ((r = sunxi_pwm_apply(&config, (__u64)(servo->min_us + servo->max_us) * 500)) < 0) {
+      return r;
+    }
+    val |= SUNXI_PWM_EN(ch) | SUNXI_PWM_CLK_GATING(ch);
+  }
+
+  /* Enable channels */
+  lock = sunxi_lock(SUNXI_LOCK_PWM);
+  sunxi_pwm_registers->ctrl |= val;
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Set PWM servo pulse width
+ * @param servo Servo
+ * @param ch PWM channel, SUNXI_PWM_CH0 or SUNXI_PWM_CH1
+ * @param pulse_us Pulse width in us, limited to the servo range
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_servo_write_us(struct sunxi_pwm_servo *servo, unsigned int ch, unsigned int pulse_us) {
+
+  struct sunxi_lock *lock;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_pwm_registers == NULL) {
+    return -EPERM;
+  }
+  if (servo->pulse_words == NULL) {
+    return -EPERM;
+  }
+  if (ch > SUNXI_PWM_CH1) {
+    return -EINVAL;
+  }
+  pulse_us = (pulse_us < servo->min_us) ? servo->min_us : (pulse_us > servo->max_us) ? servo->max_us : pulse_us;
+
+  if ((r = sunxi_pwm_lock_ready(SUNXI_PWM_RDY(ch), servo->config.period_ns, &lock)) < 0) {
+    return r;
+  }
+  sunxi_pwm_registers->ch_period[ch] = servo->pulse_words[pulse_us - servo->min_us];
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Set PWM servo angle
+ * @param servo Servo
+ * @param ch PWM channel, SUNXI_PWM_CH0 or SUNXI_PWM_CH1
+ * @param angle_ddeg Angle in tenths of degree, limited to the servo range
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_servo_write_angle(struct sunxi_pwm_servo *servo, unsigned int ch, unsigned int angle_ddeg) {
+
+  struct sunxi_lock *lock;
+  int r;
+
+  /* Check if initialization has been performed */
+  if (sunxi_pwm_registers == NULL) {
+    return -EPERM;
+  }
+  if (servo->angle_words == NULL) {
+    return -EPERM;
+  }
+  if (ch > SUNXI_PWM_CH1) {
+    return -EINVAL;
+  }
+  angle_ddeg = (angle_ddeg > servo->range_ddeg) ? servo->range_ddeg : angle_ddeg;
+
+  if ((r = sunxi_pwm_lock_ready(SUNXI_PWM_RDY(ch), servo->config.period_ns, &lock)) < 0) {
+    return r;
+  }
+  sunxi_pwm_registers->ch_period[ch] = servo->angle_words[angle_ddeg];
+  sunxi_unlock(lock);
+
+  return 0;
+}
+
+/**
+ * Set PWM servo pulse widths of both channels in the same period
+ * @param servo Servo
+ * @param pulse0_us Pulse width of channel 0 in us, limited to the servo range
+ * @param pulse1_us Pulse width of channel 1 in us, limited to the servo range
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_servo_write_sync_us(struct sunxi_pwm_servo *servo, unsigned int pulse0_us, unsigned int pulse1_us) {
+
+  /* Check if initialization has been performed */
+  if (servo->pulse_words == NULL) {
+    return -EPERM;
+  }
+  pulse0_us = (pulse0_us < servo->min_us) ? servo->min_us : (pulse0_us > servo->max_us) ? servo->max_us : pulse0_us;
+  pulse1_us = (pulse1_us < servo->min_us) ? servo->min_us : (pulse1_us > servo->max_us) ? servo->max_us : pulse1_us;
+
+  return sunxi_pwm_servo_write_sync(servo, servo->pulse_words[pulse0_us - servo->min_us], servo->pulse_words[pulse1_us - servo->min_us]);
+}
+
+/**
+ * Set PWM servo angles of both channels in the same period
+ * @param servo Servo
+ * @param angle0_ddeg Angle of channel 0 in tenths of degree, limited to the servo range
+ * @param angle1_ddeg Angle of channel 1 in tenths of degree, limited to the servo range
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_servo_write_sync_angle(struct sunxi_pwm_servo *servo, unsigned int angle0_ddeg, unsigned int angle1_ddeg) {
+
+  /* Check if initialization has been performed */
+  if (servo->angle_words == NULL) {
+    return -EPERM;
+  }
+  angle0_ddeg = (angle0_ddeg > servo->range_ddeg) ? servo->range_ddeg : angle0_ddeg;
+  angle1_ddeg = (angle1_ddeg > servo->range_ddeg) ? servo->range_ddeg : angle1_ddeg;
+
+  return sunxi_pwm_servo_write_sync(servo, servo->angle_words[angle0_ddeg], servo->angle_words[angle1_ddeg]);
+}
+
+/**
+ * Release PWM servo tables, the channels are left running
+ * @param servo Servo
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_pwm_servo_deinit(struct sunxi_pwm_servo *servo) {
+
+  free(servo->pulse_words);
+  free(servo->angle_words);
+  servo->pulse_words = NULL;
+  servo->angle_words = NULL;
 
   return 0;
 }
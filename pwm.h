@@ -14,6 +14,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sched.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
 #include <linux/types.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -32,14 +37,91 @@
 #define SUNXI_PWM_POLARITY_NORMAL               0
 #define SUNXI_PWM_POLARITY_INVERSED             1
 
+/* SUNXI PWM channel state flags, see sunxi_pwm_set_channels */
+#define SUNXI_PWM_STATE_ENABLE                  (1 << 0)
+#define SUNXI_PWM_STATE_INVERSED                (1 << 1)
+
+/* SUNXI PWM ramp profiles */
+#define SUNXI_PWM_RAMP_LINEAR                   0
+#define SUNXI_PWM_RAMP_SCURVE                   1
+#define SUNXI_PWM_RAMP_GAMMA                    2
+#define SUNXI_PWM_RAMP_TABLE                    3
+
+/* SUNXI PWM ramp gamma of the LED profile, and full scale of the table profile */
+#define SUNXI_PWM_RAMP_GAMMA_VALUE              2.2
+#define SUNXI_PWM_RAMP_TABLE_MAX                65535
+
+/* SUNXI PWM servo channels masks */
+#define SUNXI_PWM_SERVO_CH0                     (1 << SUNXI_PWM_CH0)
+#define SUNXI_PWM_SERVO_CH1                     (1 << SUNXI_PWM_CH1)
+
+/* SUNXI PWM input clock (Hz) and maximum period (clock cycles) */
+#define SUNXI_PWM_CLOCK                         24000000
+#define SUNXI_PWM_CYCLES_MAX                    0x10000
+
+
+/****************************************************************************************/
+/* Types                                                                                */
+/****************************************************************************************/
+
+/* SUNXI PWM compiled configuration, prescaler and period solved once for duty-only updates */
+struct sunxi_pwm_config {
+  unsigned int ch;
+  unsigned int prescaler;
+  unsigned int cycles;
+  __u64 period_ns;
+  __s64 error_ns;
+  __u64 scale;
+};
+
+/* SUNXI PWM ramp, duty cycle moving from from_ns to to_ns along the profile during duration_ms */
+struct sunxi_pwm_ramp {
+  unsigned int profile;
+  __u64 from_ns;
+  __u64 to_ns;
+  unsigned int duration_ms;
+  const unsigned short *table;
+  unsigned int table_len;
+};
+
+/* SUNXI PWM servo, fixed period and period register words precomputed for each pulse width (us)
+   and each angle (tenth of degree) */
+struct sunxi_pwm_servo {
+  struct sunxi_pwm_config config;
+  unsigned int min_us;
+  unsigned int max_us;
+  unsigned int range_ddeg;
+  __u64 resolution_ns;
+  unsigned int *pulse_words;
+  unsigned int *angle_words;
+};
+
 
 /****************************************************************************************/
 /* Prototypes                                                                           */
 /****************************************************************************************/
 
 int sunxi_pwm_init();
+int sunxi_pwm_deinit();
 int sunxi_pwm_set_polarity(unsigned int ch, unsigned int pol);
 int sunxi_pwm_set_config(unsigned int ch, __u64 period_ns, __u64 duty_ns);
+int sunxi_pwm_compile(unsigned int ch, __u64 period_ns, struct sunxi_pwm_config *config);
+int sunxi_pwm_apply(struct sunxi_pwm_config *config, __u64 duty_ns);
+int sunxi_pwm_write_duty(struct sunxi_pwm_config *config, __u64 duty_ns);
+int sunxi_pwm_set_duty(unsigned int ch, __u64 duty_ns);
+int sunxi_pwm_set_channels(unsigned int ch0_state, unsigned int ch1_state);
+int sunxi_pwm_ramp_init(unsigned int rate, int priority);
+int sunxi_pwm_ramp_start(unsigned int ch, struct sunxi_pwm_ramp *ramp);
+int sunxi_pwm_ramp_wait(unsigned int ch);
+int sunxi_pwm_ramp_stop(unsigned int ch);
+int sunxi_pwm_ramp_deinit();
+int sunxi_pwm_servo_init(struct sunxi_pwm_servo *servo, unsigned int period_us, unsigned int min_us, unsigned int max_us, unsigned int range_deg);
+int sunxi_pwm_servo_enable(struct sunxi_pwm_servo *servo, unsigned int channels);
+int sunxi_pwm_servo_write_us(struct sunxi_pwm_servo *servo, unsigned int ch, unsigned int pulse_us);
+int sunxi_pwm_servo_write_angle(struct sunxi_pwm_servo *servo, unsigned int ch, unsigned int angle_ddeg);
+int sunxi_pwm_servo_write_sync_us(struct sunxi_pwm_servo *servo, unsigned int pulse0_us, unsigned int pulse1_us);
+int sunxi_pwm_servo_write_sync_angle(struct sunxi_pwm_servo *servo, unsigned int angle0_ddeg, unsigned int angle1_ddeg);
+int sunxi_pwm_servo_deinit(struct sunxi_pwm_servo *servo);
 int sunxi_pwm_enable(unsigned int ch);
 int sunxi_pwm_disable(unsigned int ch);
 
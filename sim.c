@@ -0,0 +1,648 @@
+/****************************************************************************************/
+/* SUNXI simulator library interface                                                    */
+/****************************************************************************************/
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include "sim.h"
+#include "hw.h"
+#include "gpio.h"
+#include "lock.h"
+#include "spi.h"
+#include "spi_flash.h"
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* SUNXI simulated registers offsets in the IO window, in 32 bits words */
+#define SUNXI_SIM_GPIO_BANK(bank)               ((0x0800 / 4) + (bank) * SUNXI_GPIO_BANK_REGS)
+#define SUNXI_SIM_GPIO_CFG(bank, index)         (SUNXI_SIM_GPIO_BANK(bank) + (index))
+#define SUNXI_SIM_GPIO_DAT(bank)                (SUNXI_SIM_GPIO_BANK(bank) + 4)
+#define SUNXI_SIM_GPIO_INT_CFG(index)           (((0x0800 + 0x200) / 4) + (index))
+#define SUNXI_SIM_GPIO_INT_CTL                  ((0x0800 + 0x210) / 4)
+#define SUNXI_SIM_GPIO_INT_STA                  ((0x0800 + 0x214) / 4)
+#define SUNXI_SIM_LRADC_CTRL                    ((0x2800 + 0x00) / 4)
+#define SUNXI_SIM_LRADC_INTC                    ((0x2800 + 0x04) / 4)
+#define SUNXI_SIM_LRADC_INTS                    ((0x2800 + 0x08) / 4)
+#define SUNXI_SIM_LRADC_DATA(ch)                (((0x2800 + 0x0c) / 4) + (ch))
+
+/* SUNXI simulated LRADC control fields */
+#define SUNXI_SIM_LRADC_EN                      (1 << 0)
+#define SUNXI_SIM_LRADC_SAMPLE_RATE(ctrl)       (((ctrl) >> 2) & 0x3)
+#define SUNXI_SIM_LRADC_CHANNEL(ctrl)           (((ctrl) >> 22) & 0x3)
+#define SUNXI_SIM_LRADC_DATA_PENDING(ch)        (1 << (8 * (ch)))
+#define SUNXI_SIM_LRADC_KEYDOWN_PENDING(ch)     (1 << (8 * (ch) + 1))
+#define SUNXI_SIM_LRADC_ALRDY_HOLD_PENDING(ch)  (1 << (8 * (ch) + 3))
+#define SUNXI_SIM_LRADC_KEYUP_PENDING(ch)       (1 << (8 * (ch) + 4))
+
+/* SUNXI simulated LRADC key level, lower values are pressed keys (0x3F when released) */
+#define SUNXI_SIM_LRADC_KEY_LEVEL               0x3C
+
+/* SUNXI simulated spidev transfer buffer size, same as the spidev default */
+#define SUNXI_SIM_SPI_BUFSIZ                    4096
+
+/* SUNXI simulated SPI flash, 1MB (W25Q80 JEDEC ID) */
+#define SUNXI_SIM_SPI_FLASH_SIZE                (1 << 20)
+#define SUNXI_SIM_SPI_FLASH_ID                  { 0xEF, 0x40, 0x14 }
+
+/* SUNXI simulated SPI flash busy time of program/erase operations, in status reads */
+#define SUNXI_SIM_SPI_FLASH_BUSY_PROGRAM        2
+#define SUNXI_SIM_SPI_FLASH_BUSY_ERASE          4
+
+/* SUNXI simulated SPI flash */
+struct sunxi_sim_spi_flash {
+  unsigned char *memory;
+  unsigned char status;
+  unsigned char status2;
+  unsigned int busy;
+  int protect;
+};
+
+/* SUNXI simulated spidev */
+struct sunxi_sim_spi {
+  __u32 mode;
+  __u8 bits;
+  __u32 speed;
+};
+
+/* SUNXI simulator */
+struct sunxi_sim {
+  pthread_t thread;
+  volatile int running;
+  int fd;
+  volatile unsigned int *regs;
+  unsigned int period_us;
+  unsigned int gpio_input[SUNXI_GPIO_BANK_COUNT];
+  unsigned int gpio_input_prev[SUNXI_GPIO_BANK_COUNT];
+  unsigned int lradc_input[2];
+  unsigned int lradc_pressed[2];
+  unsigned long long lradc_next_ns;
+  struct sunxi_sim_spi spi;
+  struct sunxi_sim_spi_flash flash;
+};
+
+
+/****************************************************************************************/
+/* Global variables                                                                     */
+/****************************************************************************************/
+
+/* SUNXI simulator */
+static struct sunxi_sim sunxi_sim = {
+  .fd = -1,
+  .spi = { .mode = 0, .bits = 8, .speed = 1000000 }
+};
+
+
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Simulate GPIO bank, input pins reflect the simulated input levels and external interrupts are raised
+ * @param bank Simulated bank
+ */
+static void sunxi_sim_gpio_bank(unsigned int bank) {
+
+  volatile unsigned int *regs = sunxi_sim.regs;
+  unsigned int input = __atomic_load_n(&sunxi_sim.gpio_input[bank], __ATOMIC_RELAXED);
+  unsigned int prev = sunxi_sim.gpio_input_prev[bank];
+  unsigned int input_mask = 0, eint_mask = 0, sta = 0;
+  unsigned int num, function, dat, eint, trigger, level, prev_level;
+  struct sunxi_lock *lock;
+
+  /* Retrieve input and external interrupt pins */
+  for (num = 0; num < 32; num++) {
+    function = (regs[SUNXI_SIM_GPIO_CFG(bank, num >> 3)] >> ((num & 0x7) << 2)) & 0x7;
+    if (function == SUNXI_GPIO_INPUT) input_mask |= 1U << num;
+    if (function == SUNXI_GPIO_EINT) eint_mask |= 1U << num;
+  }
+
+  /* Update input pins value, output pins value is the one written */
+  dat = regs[SUNXI_SIM_GPIO_DAT(bank)];
+  if ((dat & (input_mask | eint_mask)) != (input & (input_mask | eint_mask))) {
+    lock = sunxi_lock(SUNXI_LOCK_GPIO_BANK(bank));
+    __atomic_fetch_and(&regs[SUNXI_SIM_GPIO_DAT(bank)], ~(input_mask | eint_mask) | input, __ATOMIC_SEQ_CST);
+    __atomic_fetch_or(&regs[SUNXI_SIM_GPIO_DAT(bank)], (input_mask | eint_mask) & input, __ATOMIC_SEQ_CST);
+    sunxi_unlock(lock);
+  }
+
+  /* Raise external interrupts, EINT0 to EINT21 are PH0 to PH21, EINT22 to EINT31 are PI10 to PI19 */
+  for (num = 0; num < 32; num++) {
+    if (!(eint_mask & (1U << num))) continue;
+    if ((bank == (unsigned int)SUNXI_GPIO_PORT('H')) && (num <= 21)) eint = num;
+    else if ((bank == (unsigned int)SUNXI_GPIO_PORT('I')) && (num >= 10) && (num <= 19)) eint = num - 10 + 22;
+    else continue;
+    trigger = (regs[SUNXI_SIM_GPIO_INT_CFG(eint >> 3)] >> ((eint & 0x7) << 2)) & 0xf;
+    level = (input >> num) & 0x1;
+    prev_level = (prev >> num) & 0x1;
+    if (((trigger == SUNXI_GPIO_INT_POSITIVE_EDGE) && !prev_level && level)
+        || ((trigger == SUNXI_GPIO_INT_NEGATIVE_EDGE) && prev_level && !level)
+        || ((trigger == SUNXI_GPIO_INT_HIGH_LEVEL) && level)
+        || ((trigger == SUNXI_GPIO_INT_LOW_LEVEL) && !level)
+        || ((trigger == SUNXI_GPIO_INT_DOUBLE_EDGE) && (prev_level != level))) {
+      sta |= 1U << eint;
+    }
+  }
+  sta &= regs[SUNXI_SIM_GPIO_INT_CTL];
+  if (sta != 0) {
+    __atomic_fetch_or(&regs[SUNXI_SIM_GPIO_INT_STA], sta, __ATOMIC_SEQ_CST);
+  }
+
+  sunxi_sim.gpio_input_prev[bank] = input;
+}
+
+/**
+ * Simulate LRADC, data registers and key status are updated at the configured sample rate
+ * @param now_ns Current time in ns
+ */
+static void sunxi_sim_lradc(unsigned long long now_ns) {
+
+  volatile unsigned int *regs = sunxi_sim.regs;
+  unsigned int ctrl = regs[SUNXI_SIM_LRADC_CTRL];
+  unsigned int ch, channel, val, pending = 0, keys = 0;
+
+  /* Check if LRADC is enabled and a conversion is expected */
+  if (!(ctrl & SUNXI_SIM_LRADC_EN)) {
+    sunxi_sim.lradc_next_ns = 0;
+    return;
+  }
+  if (now_ns < sunxi_sim.lradc_next_ns) {
+    return;
+  }
+
+  /* Convert enabled channels, 250Hz divided by 2^sample_rate, key down/hold/up detected on the level */
+  channel = SUNXI_SIM_LRADC_CHANNEL(ctrl);
+  for (ch = 0; ch < 2; ch++) {
+    if ((channel == 2) || (channel == ch)) {
+      val = __atomic_load_n(&sunxi_sim.lradc_input[ch], __ATOMIC_RELAXED) & 0x3F;
+      regs[SUNXI_SIM_LRADC_DATA(ch)] = val;
+      pending |= SUNXI_SIM_LRADC_DATA_PENDING(ch);
+      if (val < SUNXI_SIM_LRADC_KEY_LEVEL) {
+        keys |= sunxi_sim.lradc_pressed[ch] ? SUNXI_SIM_LRADC_ALRDY_HOLD_PENDING(ch) : SUNXI_SIM_LRADC_KEYDOWN_PENDING(ch);
+      } else if (sunxi_sim.lradc_pressed[ch]) {
+        keys |= SUNXI_SIM_LRADC_KEYUP_PENDING(ch);
+      }
+      sunxi_sim.lradc_pressed[ch] = (val < SUNXI_SIM_LRADC_KEY_LEVEL);
+    }
+  }
+  pending |= keys & regs[SUNXI_SIM_LRADC_INTC];
+  __atomic_fetch_or(&regs[SUNXI_SIM_LRADC_INTS], pending, __ATOMIC_SEQ_CST);
+  sunxi_sim.lradc_next_ns = now_ns + (4000000ULL << SUNXI_SIM_LRADC_SAMPLE_RATE(ctrl));
+}
+
+/**
+ * Simulator thread
+ * @param arg Not used
+ * @return Always NULL
+ */
+static void *sunxi_sim_thread(void *arg) {
+
+  struct timespec next;
+  unsigned long long now_ns;
+  unsigned int bank;
+
+  (void)arg;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (sunxi_sim.running) {
+
+    /* Simulate registers side effects */
+    now_ns = (unsigned long long)next.tv_sec * 1000000000ULL + next.tv_nsec;
+    for (bank = 0; bank < SUNXI_GPIO_BANK_COUNT; bank++) {
+      sunxi_sim_gpio_bank(bank);
+    }
+    sunxi_sim_lradc(now_ns);
+
+    /* Wait for next period */
+    next.tv_nsec += sunxi_sim.period_us * 1000;
+    while (next.tv_nsec >= 1000000000) {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+
+  return NULL;
+}
+
+
+/**
+ * Simulate SPI flash frame (CS asserted), only the operations of the flash layer are supported
+ * @param tx Data sent to the flash
+ * @param rx Data read from the flash
+ * @param len Length of the frame
+ */
+static void sunxi_sim_spi_flash_frame(unsigned char *tx, unsigned char *rx, unsigned int len) {
+
+  struct sunxi_sim_spi_flash *flash = &sunxi_sim.flash;
+  static const unsigned char id[3] = SUNXI_SIM_SPI_FLASH_ID;
+  unsigned int addr, index, offset, size = 0;
+
+  memset(rx, 0xFF, len);
+  if (len == 0) {
+    return;
+  }
+  addr = (len >= 4) ? (((unsigned int)tx[1] << 16) | (tx[2] << 8) | tx[3]) % SUNXI_SIM_SPI_FLASH_SIZE : 0;
+
+  /* Status register, busy operations complete after a few reads */
+  if (tx[0] == SUNXI_SPI_FLASH_CMD_RDSR) {
+    for (index = 1; index < len; index++) {
+      rx[index] = flash->status;
+    }
+    if ((flash->busy > 0) && (--flash->busy == 0)) {
+      flash->status &= ~(SUNXI_SPI_FLASH_SR_WIP | SUNXI_SPI_FLASH_SR_WEL);
+    }
+    return;
+  }
+  if (tx[0] == SUNXI_SPI_FLASH_CMD_RDSR2) {
+    for (index = 1; index < len; index++) {
+      rx[index] = flash->status2;
+    }
+    return;
+  }
+  if (flash->status & SUNXI_SPI_FLASH_SR_WIP) {
+    return;
+  }
+
+  switch (tx[0]) {
+    case SUNXI_SPI_FLASH_CMD_RDID:
+      for (index = 1; (index < len) && (index < 4); index++) {
+        rx[index] = id[index - 1];
+      }
+      break;
+    case SUNXI_SPI_FLASH_CMD_WREN:
+      if (!flash->protect) {
+        flash->status |= SUNXI_SPI_FLASH_SR_WEL;
+      }
+      break;
+    case SUNXI_SPI_FLASH_CMD_WRSR:
+      /* Status register 2 written by the second data byte, only its quad enable bit is kept */
+      if (flash->status & SUNXI_SPI_FLASH_SR_WEL) {
+        if (len >= 3) {
+          flash->status2 = tx[2] & SUNXI_SPI_FLASH_SR2_QE;
+        }
+        flash->status |= SUNXI_SPI_FLASH_SR_WIP;
+        flash->busy = SUNXI_SIM_SPI_FLASH_BUSY_PROGRAM;
+      }
+      break;
+    case SUNXI_SPI_FLASH_CMD_QUAD_READ:
+      /* IO2 and IO3 are WP# and HOLD# until quad is enabled, no data is read */
+      if (!(flash->status2 & SUNXI_SPI_FLASH_SR2_QE)) {
+        break;
+      }
+      /* Fall through */
+    case SUNXI_SPI_FLASH_CMD_READ:
+    case SUNXI_SPI_FLASH_CMD_FAST_READ:
+    case SUNXI_SPI_FLASH_CMD_DUAL_READ:
+      offset = (tx[0] == SUNXI_SPI_FLASH_CMD_READ) ? 4 : 5;
+      for (index = offset; index < len; index++) {
+        rx[index] = flash->memory[(addr + index - offset) % SUNXI_SIM_SPI_FLASH_SIZE];
+      }
+      break;
+    case SUNXI_SPI_FLASH_CMD_PP:
+      if (flash->status & SUNXI_SPI_FLASH_SR_WEL) {
+        /* Programming clears bits only, the address wraps in the page */
+        for (index = 4; index < len; index++) {
+          offset = (addr & ~(SUNXI_SPI_FLASH_PAGE_SIZE - 1)) | ((addr + index - 4) & (SUNXI_SPI_FLASH_PAGE_SIZE - 1));
+          flash->memory[offset] &= tx[index];
+        }
+        flash->status |= SUNXI_SPI_FLASH_SR_WIP;
+        flash->busy = SUNXI_SIM_SPI_FLASH_BUSY_PROGRAM;
+      }
+      break;
+    case SUNXI_SPI_FLASH_CMD_SE:
+      size = SUNXI_SPI_FLASH_SECTOR_SIZE;
+      break;
+    case SUNXI_SPI_FLASH_CMD_BE:
+      size = SUNXI_SPI_FLASH_BLOCK_SIZE;
+      break;
+    case SUNXI_SPI_FLASH_CMD_CE:
+      size = SUNXI_SIM_SPI_FLASH_SIZE;
+      break;
+    default:
+      break;
+  }
+
+  /* Erase */
+  if ((size > 0) && (flash->status & SUNXI_SPI_FLASH_SR_WEL)) {
+    memset(flash->memory + (addr & ~(size - 1)), 0xFF, size);
+    flash->status |= SUNXI_SPI_FLASH_SR_WIP;
+    flash->busy = SUNXI_SIM_SPI_FLASH_BUSY_ERASE;
+  }
+}
+
+
+/****************************************************************************************/
+/* Exported functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Initialize simulator, to be called before the interfaces initialization
+ * The registers are backed by a memfd laid out like the IO window, and a simulator thread models
+ * the side effects of the hardware (input pins, external interrupts, LRADC conversions).
+ * @param period_us Simulation period in us
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_sim_init(unsigned int period_us) {
+
+  int r;
+  void *pc;
+
+  /* Check if initialization has already been performed */
+  if (sunxi_sim.running) {
+    return -EBUSY;
+  }
+
+  /* Check period */
+  if ((period_us == 0) || (period_us >= 1000000)) {
+    return -EINVAL;
+  }
+
+  /* Create registers file */
+  sunxi_sim.fd = memfd_create("libhwsunxi-sim", MFD_CLOEXEC);
+  if (sunxi_sim.fd < 0) {
+    return -errno;
+  }
+  if (ftruncate(sunxi_sim.fd, SUNXI_HW_IO_SIZE) < 0) {
+    r = -errno;
+    goto error;
+  }
+
+  /* Map registers file */
+  pc = mmap(NULL, SUNXI_HW_IO_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, sunxi_sim.fd, 0);
+  if (pc == MAP_FAILED) {
+    r = -errno;
+    goto error;
+  }
+  sunxi_sim.regs = (volatile unsigned int *)pc;
+
+  /* Use registers file as backend */
+  if ((r = sunxi_hw_set_backend(sunxi_sim.fd, 0, SUNXI_HW_BACKEND_EMULATE_W1C)) < 0) {
+    goto error_unmap;
+  }
+
+  /* Use simulated spidev */
+  sunxi_spi_set_ioctl(sunxi_sim_spi_ioctl);
+
+  /* Start simulator thread */
+  sunxi_sim.period_us = period_us;
+  sunxi_sim.lradc_next_ns = 0;
+  sunxi_sim.lradc_pressed[0] = 0;
+  sunxi_sim.lradc_pressed[1] = 0;
+  sunxi_sim.running = 1;
+  if ((r = pthread_create(&sunxi_sim.thread, NULL, sunxi_sim_thread, NULL)) != 0) {
+    sunxi_sim.running = 0;
+    sunxi_hw_set_backend(-1, 0, 0);
+    sunxi_spi_set_ioctl(NULL);
+    r = -r;
+    goto error_unmap;
+  }
+
+  return 0;
+
+error_unmap:
+  munmap((void *)sunxi_sim.regs, SUNXI_HW_IO_SIZE);
+  sunxi_sim.regs = NULL;
+error:
+  close(sunxi_sim.fd);
+  sunxi_sim.fd = -1;
+  return r;
+}
+
+/**
+ * Release simulator, to be called after the interfaces are released
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_sim_deinit() {
+
+  /* Check if initialization has been performed */
+  if (!sunxi_sim.running) {
+    return -EPERM;
+  }
+
+  /* Stop simulator thread */
+  sunxi_sim.running = 0;
+  pthread_join(sunxi_sim.thread, NULL);
+
+  /* Release registers file and simulated spidev */
+  sunxi_hw_set_backend(-1, 0, 0);
+  sunxi_spi_set_ioctl(NULL);
+  munmap((void *)sunxi_sim.regs, SUNXI_HW_IO_SIZE);
+  sunxi_sim.regs = NULL;
+  close(sunxi_sim.fd);
+  sunxi_sim.fd = -1;
+
+  return 0;
+}
+
+/**
+ * Set simulated input level of a pin
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @param val Expected pin level, 0 or 1
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_sim_gpio_set_input(unsigned int pin, unsigned int val) {
+
+  unsigned int bank = pin >> 5;
+
+  /* Check pin */
+  if (bank >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
+
+  /* Set input level */
+  if (val)
+    __atomic_fetch_or(&sunxi_sim.gpio_input[bank], SUNXI_GPIO_PIN_MASK(pin), __ATOMIC_RELAXED);
+  else
+    __atomic_fetch_and(&sunxi_sim.gpio_input[bank], ~SUNXI_GPIO_PIN_MASK(pin), __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+/**
+ * Set simulated input value of a LRADC channel, values below 0x3C being reported as pressed keys
+ * @param ch LRADC channel, SUNXI_LRADC_CH0 or SUNXI_LRADC_CH1
+ * @param val Expected value (0 to 63)
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_sim_lradc_set_input(unsigned int ch, unsigned int val) {
+
+  /* Check channel and value */
+  if ((ch > 1) || (val > 0x3F)) {
+    return -EINVAL;
+  }
+
+  /* Set input value */
+  __atomic_store_n(&sunxi_sim.lradc_input[ch], val, __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+/**
+ * Simulated spidev ioctl, the device is a loopback (MISO connected to MOSI)
+ * Installed by sunxi_sim_init, it can also be used alone with sunxi_spi_set_ioctl. Messages are
+ * limited like spidev ones, the transfer lengths being rounded in the tx and rx buffers.
+ * @param fd File descriptor get from sunxi_spi_open, any file can be opened
+ * @param request spidev request
+ * @param arg Request argument
+ * @return Same as spidev ioctl
+ */
+int sunxi_sim_spi_ioctl(int fd, unsigned long request, void *arg) {
+
+  struct sunxi_sim_spi *spi = &sunxi_sim.spi;
+  struct spi_ioc_transfer *xfer;
+  unsigned int count, index, total = 0;
+  __u32 tx_total = 0, rx_total = 0;
+
+  (void)fd;
+
+  /* Transfers */
+  if ((_IOC_TYPE(request) == SPI_IOC_MAGIC) && (_IOC_NR(request) == 0) && (_IOC_DIR(request) == _IOC_WRITE)) {
+    if ((_IOC_SIZE(request) == 0) || (_IOC_SIZE(request) % sizeof(struct spi_ioc_transfer))) {
+      errno = EINVAL;
+      return -1;
+    }
+    xfer = (struct spi_ioc_transfer *)arg;
+    count = _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer);
+    /* Lengths rounded in the spidev buffers, as spidev does */
+    for (index = 0; index < count; index++) {
+      if (sunxi_spi_buffer_reserve(&tx_total, &rx_total, xfer[index].tx_buf != 0, xfer[index].rx_buf != 0, xfer[index].len, SUNXI_SIM_SPI_BUFSIZ) != 0) {
+        errno = EMSGSIZE;
+        return -1;
+      }
+      total += xfer[index].len;
+    }
+    for (index = 0; index < count; index++) {
+      if (xfer[index].rx_buf == 0) continue;
+      if (xfer[index].tx_buf != 0)
+        memmove((void *)(unsigned long)xfer[index].rx_buf, (void *)(unsigned long)xfer[index].tx_buf, xfer[index].len);
+      else
+        memset((void *)(unsigned long)xfer[index].rx_buf, 0, xfer[index].len);
+    }
+    return total;
+  }
+
+  /* Settings */
+  switch (request) {
+    case SPI_IOC_RD_MODE:
+      *(__u8 *)arg = spi->mode & 0xFF;
+      return 0;
+    case SPI_IOC_WR_MODE:
+      spi->mode = (spi->mode & ~0xFF) | *(__u8 *)arg;
+      return 0;
+    case SPI_IOC_RD_MODE32:
+      *(__u32 *)arg = spi->mode;
+      return 0;
+    case SPI_IOC_WR_MODE32:
+      spi->mode = *(__u32 *)arg;
+      return 0;
+    case SPI_IOC_RD_LSB_FIRST:
+      *(__u8 *)arg = (spi->mode & SPI_LSB_FIRST) ? 1 : 0;
+      return 0;
+    case SPI_IOC_WR_LSB_FIRST:
+      if (*(__u8 *)arg) spi->mode |= SPI_LSB_FIRST; else spi->mode &= ~SPI_LSB_FIRST;
+      return 0;
+    case SPI_IOC_RD_BITS_PER_WORD:
+      *(__u8 *)arg = spi->bits;
+      return 0;
+    case SPI_IOC_WR_BITS_PER_WORD:
+      spi->bits = *(__u8 *)arg;
+      return 0;
+    case SPI_IOC_RD_MAX_SPEED_HZ:
+      *(__u32 *)arg = spi->speed;
+      return 0;
+    case SPI_IOC_WR_MAX_SPEED_HZ:
+      spi->speed = *(__u32 *)arg;
+      return 0;
+    default:
+      errno = ENOTTY;
+      return -1;
+  }
+}
+
+/**
+ * Simulated spidev ioctl, the device is a SPI NOR flash (JEDEC commands of the flash layer)
+ * The flash content is kept while the process runs, it is erased (0xFF) initially, quad reads
+ * return data once the quad enable bit has been set.
+ * @param fd File descriptor get from sunxi_spi_open, any file can be opened
+ * @param request spidev request
+ * @param arg Request argument
+ * @return Same as spidev ioctl
+ */
+int sunxi_sim_spi_flash_ioctl(int fd, unsigned long request, void *arg) {
+
+  struct sunxi_sim_spi_flash *flash = &sunxi_sim.flash;
+  struct spi_ioc_transfer *xfer;
+  unsigned char tx[SUNXI_SIM_SPI_BUFSIZ], rx[SUNXI_SIM_SPI_BUFSIZ];
+  unsigned int count, index, first, len, offset, total = 0;
+  __u32 tx_total = 0, rx_total = 0;
+
+  /* Settings, same as the loopback device */
+  if (!((_IOC_TYPE(request) == SPI_IOC_MAGIC) && (_IOC_NR(request) == 0) && (_IOC_DIR(request) == _IOC_WRITE))) {
+    return sunxi_sim_spi_ioctl(fd, request, arg);
+  }
+
+  /* Transfers */
+  if ((_IOC_SIZE(request) == 0) || (_IOC_SIZE(request) % sizeof(struct spi_ioc_transfer))) {
+    errno = EINVAL;
+    return -1;
+  }
+  xfer = (struct spi_ioc_transfer *)arg;
+  count = _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer);
+  for (index = 0; index < count; index++) {
+    if (sunxi_spi_buffer_reserve(&tx_total, &rx_total, xfer[index].tx_buf != 0, xfer[index].rx_buf != 0, xfer[index].len, SUNXI_SIM_SPI_BUFSIZ) != 0) {
+      errno = EMSGSIZE;
+      return -1;
+    }
+    total += xfer[index].len;
+  }
+  if (total > SUNXI_SIM_SPI_BUFSIZ) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  if (flash->memory == NULL) {
+    if ((flash->memory = malloc(SUNXI_SIM_SPI_FLASH_SIZE)) == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+    memset(flash->memory, 0xFF, SUNXI_SIM_SPI_FLASH_SIZE);
+  }
+
+  /* Frames, CS is released after a transfer with cs_change and at the end of the message */
+  for (first = 0, index = 0; index < count; index++) {
+    if (!xfer[index].cs_change && (index < count - 1)) {
+      continue;
+    }
+    for (len = 0, offset = first; offset <= index; offset++) {
+      if (xfer[offset].tx_buf != 0)
+        memcpy(tx + len, (void *)(unsigned long)xfer[offset].tx_buf, xfer[offset].len);
+      else
+        memset(tx + len, 0, xfer[offset].len);
+      len += xfer[offset].len;
+    }
+    sunxi_sim_spi_flash_frame(tx, rx, len);
+    for (len = 0, offset = first; offset <= index; offset++) {
+      if (xfer[offset].rx_buf != 0)
+        memcpy((void *)(unsigned long)xfer[offset].rx_buf, rx + len, xfer[offset].len);
+      len += xfer[offset].len;
+    }
+    first = index + 1;
+  }
+  return total;
+}
+
+/**
+ * Set simulated SPI flash write protection, write enable commands being then ignored (WP# asserted)
+ * @param protect 1 to protect the flash, 0 otherwise
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_sim_spi_flash_set_protect(int protect) {
+
+  sunxi_sim.flash.protect = protect;
+
+  return 0;
+}
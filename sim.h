@@ -0,0 +1,39 @@
+/****************************************************************************************/
+/* SUNXI simulator library interface                                                    */
+/****************************************************************************************/
+
+#ifndef SUNXI_SIM_H_
+#define SUNXI_SIM_H_
+
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <linux/spi/spidev.h>
+
+
+/****************************************************************************************/
+/* Prototypes                                                                           */
+/****************************************************************************************/
+
+int sunxi_sim_init(unsigned int period_us);
+int sunxi_sim_deinit();
+int sunxi_sim_gpio_set_input(unsigned int pin, unsigned int val);
+int sunxi_sim_lradc_set_input(unsigned int ch, unsigned int val);
+int sunxi_sim_spi_ioctl(int fd, unsigned long request, void *arg);
+int sunxi_sim_spi_flash_ioctl(int fd, unsigned long request, void *arg);
+int sunxi_sim_spi_flash_set_protect(int protect);
+
+
+#endif
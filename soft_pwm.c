@@ -0,0 +1,406 @@
+/****************************************************************************************/
+/* SUNXI software PWM library interface                                                 */
+/****************************************************************************************/
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include "soft_pwm.h"
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* SUNXI software PWM channel, new period and duty cycle applied at the next period start */
+struct sunxi_soft_pwm_channel {
+  int used;
+  unsigned int pin;
+  __u64 period_ns;
+  __u64 duty_ns;
+  __u64 next_period_ns;
+  __u64 next_duty_ns;
+  int falling;
+  __u64 start_ns;
+  __u64 edge_ns;
+};
+
+/* SUNXI software PWM engine, condition on the monotonic clock, running until the thread is joined */
+struct sunxi_soft_pwm {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int running;
+  int stopping;
+  unsigned int count;
+  struct sunxi_soft_pwm_channel channels[SUNXI_SOFT_PWM_CHANNELS_MAX];
+  struct sunxi_soft_pwm_stats stats;
+};
+
+
+/****************************************************************************************/
+/* Global variables                                                                     */
+/****************************************************************************************/
+
+/* SUNXI software PWM engine */
+static struct sunxi_soft_pwm sunxi_soft_pwm = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Get monotonic time in ns
+ * @return Time in ns
+ */
+static __u64 sunxi_soft_pwm_now() {
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (__u64)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Advance software PWM channel past its next edge, engine mutex held
+ * @param channel Channel
+ * @return Level of the pin after the edge
+ */
+static unsigned int sunxi_soft_pwm_advance(struct sunxi_soft_pwm_channel *channel) {
+
+  /* End of duty cycle */
+  if (channel->falling) {
+    channel->falling = 0;
+    channel->edge_ns = channel->start_ns + channel->period_ns;
+    return 0;
+  }
+
+  /* Period start, new configuration applied */
+  channel->start_ns = channel->edge_ns;
+  channel->period_ns = channel->next_period_ns;
+  channel->duty_ns = channel->next_duty_ns;
+  if (channel->duty_ns == 0) {
+    channel->edge_ns = channel->start_ns + channel->period_ns;
+    return 0;
+  }
+  if (channel->duty_ns >= channel->period_ns) {
+    channel->edge_ns = channel->start_ns + channel->period_ns;
+    return 1;
+  }
+  channel->falling = 1;
+  channel->edge_ns = channel->start_ns + channel->duty_ns;
+  return 1;
+}
+
+/**
+ * Software PWM thread, edges of all the channels are taken in time order, the edges closer than
+ * SUNXI_SOFT_PWM_MERGE_NS being written at the same deadline with one store per bank
+ * The thread waits for the next edge on the engine condition, so that added or removed channels
+ * wake it up, the next edge being computed again after every wake-up.
+ * @param arg Unused
+ * @return NULL
+ */
+static void *sunxi_soft_pwm_thread(void *arg) {
+
+  struct sunxi_soft_pwm *engine = &sunxi_soft_pwm;
+  struct sunxi_soft_pwm_channel *channel;
+  struct sunxi_gpio_port_set set;
+  struct timespec deadline;
+  __u64 edge_ns, now_ns, late_ns;
+  unsigned int index, edges;
+
+  (void)arg;
+
+  pthread_mutex_lock(&engine->mutex);
+  while (!engine->stopping) {
+
+    /* Sleep while no channel is used */
+    if (engine->count == 0) {
+      pthread_cond_wait(&engine->cond, &engine->mutex);
+      continue;
+    }
+
+    /* Next edge of the timeline */
+    edge_ns = ~0ULL;
+    for (index = 0; index < SUNXI_SOFT_PWM_CHANNELS_MAX; index++) {
+      channel = &engine->channels[index];
+      if (channel->used && (channel->edge_ns < edge_ns)) {
+        edge_ns = channel->edge_ns;
+      }
+    }
+
+    /* Wait for the deadline, or for a channel change */
+    now_ns = sunxi_soft_pwm_now();
+    if (now_ns < edge_ns) {
+      deadline.tv_sec = edge_ns / 1000000000ULL;
+      deadline.tv_nsec = edge_ns % 1000000000ULL;
+      pthread_cond_timedwait(&engine->cond, &engine->mutex, &deadline);
+      continue;
+    }
+
+    /* Pins values of the edges at this deadline, a late channel being shifted instead of bursting its missed edges */
+    memset(&set, 0, sizeof(struct sunxi_gpio_port_set));
+    edges = 0;
+    for (index = 0; index < SUNXI_SOFT_PWM_CHANNELS_MAX; index++) {
+      channel = &engine->channels[index];
+      if (!channel->used || (channel->edge_ns > edge_ns + SUNXI_SOFT_PWM_MERGE_NS)) {
+        continue;
+      }
+      if (now_ns > channel->edge_ns + SUNXI_SOFT_PWM_LATE_NS) {
+        late_ns = now_ns - channel->edge_ns;
+        channel->start_ns += late_ns;
+        channel->edge_ns += late_ns;
+        engine->stats.late++;
+      }
+      sunxi_gpio_port_set_pin(&set, channel->pin, sunxi_soft_pwm_advance(channel));
+      edges++;
+    }
+    sunxi_gpio_port_write(&set);
+
+    engine->stats.wakeups++;
+    engine->stats.edges += edges;
+    engine->stats.jitter_total_ns += now_ns - edge_ns;
+    if (now_ns - edge_ns > engine->stats.jitter_max_ns) {
+      engine->stats.jitter_max_ns = now_ns - edge_ns;
+    }
+  }
+  pthread_mutex_unlock(&engine->mutex);
+  return NULL;
+}
+
+
+/****************************************************************************************/
+/* Exported functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Start software PWM engine, a single thread generating all the channels
+ * The GPIO interface must be initialized. The engine is started once, further calls return -EBUSY
+ * until sunxi_soft_pwm_deinit.
+ * @param priority SCHED_FIFO priority of the thread, 0 for a normal thread (also used if not permitted)
+ * @param cpu CPU the thread is pinned to, -1 to not pin it
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_soft_pwm_init(int priority, int cpu) {
+
+  struct sunxi_soft_pwm *engine = &sunxi_soft_pwm;
+  struct sched_param param;
+  pthread_attr_t attr;
+  pthread_condattr_t cond_attr;
+  cpu_set_t cpus;
+  int r;
+
+  /* Check if initialization has already been performed, the thread being created under the mutex so
+     that it is started before being seen running */
+  pthread_mutex_lock(&engine->mutex);
+  if (engine->running) {
+    pthread_mutex_unlock(&engine->mutex);
+    return -EBUSY;
+  }
+  memset(engine->channels, 0, sizeof(engine->channels));
+  memset(&engine->stats, 0, sizeof(struct sunxi_soft_pwm_stats));
+  engine->count = 0;
+  engine->running = 1;
+
+  /* Initialize condition on the monotonic clock, the clock of the edges deadlines */
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&engine->cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  /* Start pinned real-time thread, normal thread if not permitted */
+  pthread_attr_init(&attr);
+  if (cpu >= 0) {
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpus);
+  }
+  if (priority > 0) {
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    param.sched_priority = priority;
+    pthread_attr_setschedparam(&attr, &param);
+  }
+  r = pthread_create(&engine->thread, &attr, sunxi_soft_pwm_thread, NULL);
+  if ((r == EPERM) && (priority > 0)) {
+    pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+    r = pthread_create(&engine->thread, &attr, sunxi_soft_pwm_thread, NULL);
+  }
+  pthread_attr_destroy(&attr);
+  if (r != 0) {
+    engine->running = 0;
+    pthread_cond_destroy(&engine->cond);
+    pthread_mutex_unlock(&engine->mutex);
+    return -r;
+  }
+  pthread_mutex_unlock(&engine->mutex);
+
+  return 0;
+}
+
+/**
+ * Set software PWM channel, the pin is configured as output at first call
+ * The new period and duty cycle are applied at the next period start of the channel.
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @param period_ns PWM period in ns
+ * @param duty_ns PWM duty cycle in ns
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_soft_pwm_set(unsigned int pin, __u64 period_ns, __u64 duty_ns) {
+
+  struct sunxi_soft_pwm *engine = &sunxi_soft_pwm;
+  struct sunxi_soft_pwm_channel *channel = NULL;
+  unsigned int index;
+  int r;
+
+  if ((period_ns < 2 * SUNXI_SOFT_PWM_MERGE_NS) || ((pin >> 5) >= SUNXI_GPIO_BANK_COUNT)) {
+    return -EINVAL;
+  }
+
+  /* Check if initialization has been performed */
+  pthread_mutex_lock(&engine->mutex);
+  if (!engine->running || engine->stopping) {
+    pthread_mutex_unlock(&engine->mutex);
+    return -EPERM;
+  }
+
+  /* Update channel */
+  for (index = 0; index < SUNXI_SOFT_PWM_CHANNELS_MAX; index++) {
+    if (engine->channels[index].used && (engine->channels[index].pin == pin)) {
+      engine->channels[index].next_period_ns = period_ns;
+      engine->channels[index].next_duty_ns = duty_ns;
+      pthread_cond_broadcast(&engine->cond);
+      pthread_mutex_unlock(&engine->mutex);
+      return 0;
+    }
+    if (!engine->channels[index].used && (channel == NULL)) {
+      channel = &engine->channels[index];
+    }
+  }
+
+  /* Add channel, started at once */
+  if (channel == NULL) {
+    pthread_mutex_unlock(&engine->mutex);
+    return -ENOSPC;
+  }
+  if (((r = sunxi_gpio_output(pin, 0)) < 0) || ((r = sunxi_gpio_set_cfgpin(pin, SUNXI_GPIO_OUTPUT)) < 0)) {
+    pthread_mutex_unlock(&engine->mutex);
+    return r;
+  }
+  memset(channel, 0, sizeof(struct sunxi_soft_pwm_channel));
+  channel->pin = pin;
+  channel->period_ns = period_ns;
+  channel->next_period_ns = period_ns;
+  channel->next_duty_ns = duty_ns;
+  channel->start_ns = sunxi_soft_pwm_now() + SUNXI_SOFT_PWM_MERGE_NS;
+  channel->edge_ns = channel->start_ns;
+  channel->used = 1;
+  engine->count++;
+  pthread_cond_broadcast(&engine->cond);
+  pthread_mutex_unlock(&engine->mutex);
+
+  return 0;
+}
+
+/**
+ * Remove software PWM channel, the pin is left low
+ * @param pin Expected pin, see SUNXI_GPIO_PIN macros
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_soft_pwm_remove(unsigned int pin) {
+
+  struct sunxi_soft_pwm *engine = &sunxi_soft_pwm;
+  unsigned int index;
+  int r;
+
+  if ((pin >> 5) >= SUNXI_GPIO_BANK_COUNT) {
+    return -EINVAL;
+  }
+
+  /* Check if initialization has been performed */
+  pthread_mutex_lock(&engine->mutex);
+  if (!engine->running || engine->stopping) {
+    pthread_mutex_unlock(&engine->mutex);
+    return -EPERM;
+  }
+
+  /* Remove channel, the pin being written before the thread can write it again */
+  for (index = 0; index < SUNXI_SOFT_PWM_CHANNELS_MAX; index++) {
+    if (engine->channels[index].used && (engine->channels[index].pin == pin)) {
+      engine->channels[index].used = 0;
+      engine->count--;
+      r = sunxi_gpio_output(pin, 0);
+      pthread_cond_broadcast(&engine->cond);
+      pthread_mutex_unlock(&engine->mutex);
+      return r;
+    }
+  }
+  pthread_mutex_unlock(&engine->mutex);
+
+  return -EINVAL;
+}
+
+/**
+ * Get software PWM statistics
+ * @param stats Statistics since the start of the engine or the previous reset
+ * @param reset 1 to reset the statistics, 0 otherwise
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_soft_pwm_get_stats(struct sunxi_soft_pwm_stats *stats, int reset) {
+
+  struct sunxi_soft_pwm *engine = &sunxi_soft_pwm;
+
+  pthread_mutex_lock(&engine->mutex);
+  *stats = engine->stats;
+  if (reset) {
+    memset(&engine->stats, 0, sizeof(struct sunxi_soft_pwm_stats));
+  }
+  pthread_mutex_unlock(&engine->mutex);
+
+  return 0;
+}
+
+/**
+ * Stop software PWM engine, the pins of the channels are left low
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_soft_pwm_deinit() {
+
+  struct sunxi_soft_pwm *engine = &sunxi_soft_pwm;
+  unsigned int index;
+  pthread_t thread;
+
+  /* Check if initialization has been performed, the engine being stopped once */
+  pthread_mutex_lock(&engine->mutex);
+  if (!engine->running || engine->stopping) {
+    pthread_mutex_unlock(&engine->mutex);
+    return -EPERM;
+  }
+
+  /* Release pins, the thread not writing them anymore once the mutex is released */
+  for (index = 0; index < SUNXI_SOFT_PWM_CHANNELS_MAX; index++) {
+    if (engine->channels[index].used) {
+      sunxi_gpio_output(engine->channels[index].pin, 0);
+      engine->channels[index].used = 0;
+    }
+  }
+  engine->count = 0;
+
+  /* Stop thread, still seen running until joined so that it is not started again meanwhile */
+  engine->stopping = 1;
+  thread = engine->thread;
+  pthread_cond_broadcast(&engine->cond);
+  pthread_mutex_unlock(&engine->mutex);
+  pthread_join(thread, NULL);
+  pthread_mutex_lock(&engine->mutex);
+  pthread_cond_destroy(&engine->cond);
+  engine->stopping = 0;
+  engine->running = 0;
+  pthread_mutex_unlock(&engine->mutex);
+
+  return 0;
+}
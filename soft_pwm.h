@@ -0,0 +1,62 @@
+/****************************************************************************************/
+/* SUNXI software PWM library interface                                                 */
+/****************************************************************************************/
+
+#ifndef SUNXI_SOFT_PWM_H_
+#define SUNXI_SOFT_PWM_H_
+
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <linux/types.h>
+
+#include "gpio.h"
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* SUNXI software PWM maximum number of channels */
+#define SUNXI_SOFT_PWM_CHANNELS_MAX             32
+
+/* SUNXI software PWM edges closer than this interval (ns) are written by the same stores */
+#define SUNXI_SOFT_PWM_MERGE_NS                 1000
+
+/* SUNXI software PWM lateness (ns) after which a channel is shifted instead of catching up */
+#define SUNXI_SOFT_PWM_LATE_NS                  1000000
+
+
+/****************************************************************************************/
+/* Types                                                                                */
+/****************************************************************************************/
+
+/* SUNXI software PWM statistics, jitter measured between the edge deadlines and the wake-ups */
+struct sunxi_soft_pwm_stats {
+  unsigned long long wakeups;
+  unsigned long long edges;
+  unsigned long long late;
+  unsigned long long jitter_total_ns;
+  unsigned long long jitter_max_ns;
+};
+
+
+/****************************************************************************************/
+/* Prototypes                                                                           */
+/****************************************************************************************/
+
+int sunxi_soft_pwm_init(int priority, int cpu);
+int sunxi_soft_pwm_set(unsigned int pin, __u64 period_ns, __u64 duty_ns);
+int sunxi_soft_pwm_remove(unsigned int pin);
+int sunxi_soft_pwm_get_stats(struct sunxi_soft_pwm_stats *stats, int reset);
+int sunxi_soft_pwm_deinit();
+
+
+#endif
@@ -9,10 +9,388 @@
 #include "spi.h"
 
 
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Default SPI device ioctl
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param request spidev request
+ * @param arg Request argument
+ * @return ioctl return value
+ */
+static int sunxi_spi_ioctl_default(int fd, unsigned long request, void *arg) {
+
+    return ioctl(fd, request, arg);
+}
+
+
+/****************************************************************************************/
+/* Global variables                                                                     */
+/****************************************************************************************/
+
+/* SUNXI SPI device ioctl, can be replaced by a stand-in to run without spidev */
+static int (*sunxi_spi_ioctl)(int fd, unsigned long request, void *arg) = sunxi_spi_ioctl_default;
+
+/* SUNXI SPI spidev buffer size and segment size of large transfers, 0 if not yet detected, protected
+   by the mutex */
+static __u32 sunxi_spi_bufsiz = 0;
+static __u32 sunxi_spi_segment_size = 0;
+static pthread_mutex_t sunxi_spi_sizes_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/****************************************************************************************/
+/* Transfer internal functions                                                          */
+/****************************************************************************************/
+
+/**
+ * Get SPI transfers array of a message, on the stack up to SUNXI_SPI_SEGMENTS_STACK transfers,
+ * allocated above, cleared
+ * @param stack Transfers array on the stack, SUNXI_SPI_SEGMENTS_STACK transfers
+ * @param count Number of transfers (1 to SUNXI_SPI_SEGMENTS_MAX)
+ * @return Transfers array to be released with sunxi_spi_transfers_put, NULL if the allocation fails
+ */
+static struct spi_ioc_transfer *sunxi_spi_transfers_get(struct spi_ioc_transfer *stack, unsigned int count) {
+
+    if (count > SUNXI_SPI_SEGMENTS_STACK) {
+        return calloc(count, sizeof(struct spi_ioc_transfer));
+    }
+    memset(stack, 0, sizeof(struct spi_ioc_transfer) * count);
+    return stack;
+}
+
+/**
+ * Release SPI transfers array get from sunxi_spi_transfers_get
+ * @param stack Transfers array on the stack
+ * @param transfers Transfers array to be released
+ */
+static void sunxi_spi_transfers_put(struct spi_ioc_transfer *stack, struct spi_ioc_transfer *transfers) {
+
+    if (transfers != stack) {
+        free(transfers);
+    }
+}
+
+/**
+ * Transfer SPI segments in a single message
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param segments Segments to be transferred
+ * @param count Number of segments (1 to SUNXI_SPI_SEGMENTS_MAX)
+ * @return 0 if the function succeeds, error code otherwise
+ */
+static int sunxi_spi_segments_submit(int fd, struct sunxi_spi_segment *segments, unsigned int count) {
+
+    struct spi_ioc_transfer stack[SUNXI_SPI_SEGMENTS_STACK], *ioc_transfers;
+    unsigned int index;
+    int result = 0;
+
+    if ((count == 0) || (count > SUNXI_SPI_SEGMENTS_MAX)) {
+        return EINVAL;
+    }
+    if ((ioc_transfers = sunxi_spi_transfers_get(stack, count)) == NULL) {
+        return ENOMEM;
+    }
+    for (index = 0; index < count; index++) {
+        ioc_transfers[index].tx_buf = (unsigned long)segments[index].tx;
+        ioc_transfers[index].rx_buf = (unsigned long)segments[index].rx;
+        ioc_transfers[index].len = segments[index].len;
+        ioc_transfers[index].speed_hz = segments[index].speed;
+        ioc_transfers[index].bits_per_word = segments[index].bits;
+        ioc_transfers[index].delay_usecs = segments[index].delay_usecs;
+        ioc_transfers[index].cs_change = segments[index].cs_change;
+    }
+    if (sunxi_spi_ioctl(fd, SPI_IOC_MESSAGE(count), ioc_transfers) < 0) {
+        result = errno;
+    }
+    sunxi_spi_transfers_put(stack, ioc_transfers);
+    return result;
+}
+
+/**
+ * Transfer SPI data split in segments, grouped in messages of at most count segments
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param tx Data to be written to the SPi interface, NULL if not defined
+ * @param rx Data to be read from the SPi interface, NULL if not defined
+ * @param len Length of data to be writen/read
+ * @param speed Speed of SPI interface, 32bits format (Hz), 0 to use max speed
+ * @param bits Bits per word, 0 to use the device setting
+ * @param segment_size Segment size, messages not exceeding the spidev buffer size with count segments
+ * @param count Number of segments per message (1 to SUNXI_SPI_SEGMENTS_MAX)
+ * @return 0 if the function succeeds, error code otherwise
+ */
+static int sunxi_spi_large_submit(int fd, unsigned char *tx, unsigned char *rx, __u32 len, __u32 speed, __u8 bits, __u32 segment_size, unsigned int count) {
+
+    struct spi_ioc_transfer stack[SUNXI_SPI_SEGMENTS_STACK], *ioc_transfers;
+    __u32 offset = 0, seglen;
+    unsigned int index;
+    int result = 0;
+
+    if ((count == 0) || (count > SUNXI_SPI_SEGMENTS_MAX)) {
+        return EINVAL;
+    }
+    if ((ioc_transfers = sunxi_spi_transfers_get(stack, count)) == NULL) {
+        return ENOMEM;
+    }
+    while ((offset < len) && (result == 0)) {
+
+        /* Build message */
+        for (index = 0; (offset < len) && (index < count); index++) {
+            seglen = ((len - offset) < segment_size) ? (len - offset) : segment_size;
+            ioc_transfers[index].tx_buf = (tx != NULL) ? (unsigned long)(tx + offset) : 0;
+            ioc_transfers[index].rx_buf = (rx != NULL) ? (unsigned long)(rx + offset) : 0;
+            ioc_transfers[index].len = seglen;
+            ioc_transfers[index].speed_hz = speed;
+            ioc_transfers[index].bits_per_word = bits;
+            offset += seglen;
+
+            /* Keep CS asserted after the message if the transfer is not complete */
+            ioc_transfers[index].cs_change = ((index == count - 1) && (offset < len)) ? 1 : 0;
+        }
+
+        /* Transfer message */
+        if (sunxi_spi_ioctl(fd, SPI_IOC_MESSAGE(index), ioc_transfers) < 0) {
+            result = errno;
+        }
+    }
+    sunxi_spi_transfers_put(stack, ioc_transfers);
+    return result;
+}
+
+
+/****************************************************************************************/
+/* Asynchronous queue internal functions                                                */
+/****************************************************************************************/
+
+/**
+ * SPI queue worker thread, coalesce the queued requests in messages as large as the spidev buffer
+ * allows, complete them through the callbacks and the eventfd
+ * @param arg SPI queue
+ * @return NULL
+ */
+static void *sunxi_spi_queue_thread(void *arg) {
+
+    struct sunxi_spi_queue *queue = (struct sunxi_spi_queue *)arg;
+    struct sunxi_spi_request *request;
+    __u32 bufsiz, tx_total, rx_total;
+    unsigned int count, index;
+    uint64_t value;
+    int status;
+
+    sunxi_spi_get_bufsiz(&bufsiz);
+    pthread_mutex_lock(&queue->mutex);
+    while (1) {
+        while (queue->running && (queue->count == 0)) {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+        if (queue->count == 0) {
+            break;
+        }
+
+        /* Build message from the requests, requests stay in the ring until completed, the first one
+           being sent even if it does not fit (its own error reported) */
+        count = 0;
+        tx_total = 0;
+        rx_total = 0;
+        while (count < queue->count) {
+            request = &queue->requests[(queue->head + count) % SUNXI_SPI_QUEUE_SIZE];
+            if ((sunxi_spi_buffer_reserve(&tx_total, &rx_total, request->segment.tx != NULL, request->segment.rx != NULL,
+                                          request->segment.len, bufsiz) != 0) && (count > 0)) {
+                break;
+            }
+            count++;
+        }
+        pthread_mutex_unlock(&queue->mutex);
+
+        memset(queue->transfers, 0, sizeof(struct spi_ioc_transfer) * count);
+        for (index = 0; index < count; index++) {
+            request = &queue->requests[(queue->head + index) % SUNXI_SPI_QUEUE_SIZE];
+            queue->transfers[index].tx_buf = (unsigned long)request->segment.tx;
+            queue->transfers[index].rx_buf = (unsigned long)request->segment.rx;
+            queue->transfers[index].len = request->segment.len;
+            queue->transfers[index].speed_hz = request->segment.speed;
+            queue->transfers[index].bits_per_word = request->segment.bits;
+            /* Inside a message cs_change releases CS, a request keeps CS asserted only if asked to */
+            queue->transfers[index].cs_change = (index < count - 1) ? !request->segment.cs_change : request->segment.cs_change;
+        }
+        status = (sunxi_spi_ioctl(queue->fd, SPI_IOC_MESSAGE(count), queue->transfers) < 0) ? errno : 0;
+
+        /* Complete requests */
+        for (index = 0; index < count; index++) {
+            request = &queue->requests[(queue->head + index) % SUNXI_SPI_QUEUE_SIZE];
+            if (request->callback != NULL) {
+                request->callback(request->arg, status);
+            }
+        }
+        value = count;
+        if (write(queue->efd, &value, sizeof(value)) < 0) {
+            /* Counter overflow only, completions are also reported by the callbacks */
+        }
+
+        pthread_mutex_lock(&queue->mutex);
+        if ((status != 0) && (queue->status == 0)) {
+            queue->status = status;
+        }
+        queue->head = (queue->head + count) % SUNXI_SPI_QUEUE_SIZE;
+        queue->count -= count;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return NULL;
+}
+
+
+/****************************************************************************************/
+/* Bus arbiter internal functions                                                       */
+/****************************************************************************************/
+
+/**
+ * Check if SPI bus client must be granted before another one, bus mutex held
+ * @param client SPI bus client
+ * @param other Other SPI bus client
+ * @return 1 if client comes first, 0 otherwise
+ */
+static int sunxi_spi_bus_before(struct sunxi_spi_bus_client *client, struct sunxi_spi_bus_client *other) {
+
+    if (client->priority != other->priority) {
+        return client->priority > other->priority;
+    }
+    /* Jobs without deadline (0) come after jobs with a deadline */
+    if ((client->deadline.tv_sec != other->deadline.tv_sec) || (client->deadline.tv_nsec != other->deadline.tv_nsec)) {
+        if (other->deadline.tv_sec == 0 && other->deadline.tv_nsec == 0) return 1;
+        if (client->deadline.tv_sec == 0 && client->deadline.tv_nsec == 0) return 0;
+        if (client->deadline.tv_sec != other->deadline.tv_sec) {
+            return client->deadline.tv_sec < other->deadline.tv_sec;
+        }
+        return client->deadline.tv_nsec < other->deadline.tv_nsec;
+    }
+    return client->ticket < other->ticket;
+}
+
+/**
+ * Check if a waiting SPI bus client must be granted before the given one, bus mutex held
+ * @param client SPI bus client
+ * @return 1 if another client waits with precedence, 0 otherwise
+ */
+static int sunxi_spi_bus_preceded(struct sunxi_spi_bus_client *client) {
+
+    struct sunxi_spi_bus *bus = client->bus;
+    unsigned int index;
+
+    for (index = 0; index < bus->count; index++) {
+        if ((bus->clients[index] != client) && bus->clients[index]->waiting && sunxi_spi_bus_before(bus->clients[index], client)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Acquire SPI bus, wait until the bus is free and no waiting client has precedence, bus mutex held
+ * The client ticket is drawn once per job, so that a preempted job keeps its age.
+ * @param client SPI bus client
+ * @return Wait time (ns)
+ */
+static unsigned long long sunxi_spi_bus_acquire(struct sunxi_spi_bus_client *client) {
+
+    struct sunxi_spi_bus *bus = client->bus;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    client->waiting = 1;
+    while ((bus->owner != NULL) || sunxi_spi_bus_preceded(client)) {
+        pthread_cond_wait(&bus->cond, &bus->mutex);
+    }
+    client->waiting = 0;
+    bus->owner = client;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+}
+
+/**
+ * Release SPI bus, bus mutex held
+ * @param client SPI bus client
+ */
+static void sunxi_spi_bus_release(struct sunxi_spi_bus_client *client) {
+
+    client->bus->owner = NULL;
+    pthread_cond_broadcast(&client->bus->cond);
+}
+
+
+/****************************************************************************************/
+/* Stream internal functions                                                            */
+/****************************************************************************************/
+
+/**
+ * SPI stream worker thread, transfer batches of buffers back-to-back, the oldest unread buffers
+ * being dropped (overrun) if the ring is full
+ * @param arg SPI stream
+ * @return NULL
+ */
+static void *sunxi_spi_stream_thread(void *arg) {
+
+    struct sunxi_spi_stream *stream = (struct sunxi_spi_stream *)arg;
+    unsigned int index, slot, drop;
+    int status;
+
+    pthread_mutex_lock(&stream->mutex);
+    while (stream->running) {
+
+        /* Free the slots of the batch */
+        if (stream->count - stream->ready < stream->batch) {
+            drop = stream->batch - (stream->count - stream->ready);
+            stream->head = (stream->head + drop) % stream->count;
+            stream->ready -= drop;
+            stream->overruns += drop;
+        }
+        pthread_mutex_unlock(&stream->mutex);
+
+        /* Transfer batch, each buffer being a CS frame */
+        for (index = 0; index < stream->batch; index++) {
+            slot = (stream->next + index) % stream->count;
+            if (stream->fill != NULL) {
+                stream->fill(stream->arg, stream->tx[slot], stream->len);
+            }
+            stream->transfers[index].tx_buf = (stream->fill != NULL) ? (unsigned long)stream->tx[slot] : 0;
+            stream->transfers[index].rx_buf = (unsigned long)stream->rx[slot];
+            stream->transfers[index].len = stream->len;
+            stream->transfers[index].cs_change = (index < stream->batch - 1) ? 1 : 0;
+        }
+        status = (sunxi_spi_ioctl(stream->fd, SPI_IOC_MESSAGE(stream->batch), stream->transfers) < 0) ? errno : 0;
+
+        pthread_mutex_lock(&stream->mutex);
+        if (status != 0) {
+            stream->status = status;
+            stream->running = 0;
+        } else {
+            stream->next = (stream->next + stream->batch) % stream->count;
+            stream->ready += stream->batch;
+            stream->buffers += stream->batch;
+        }
+        pthread_cond_broadcast(&stream->cond);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+    return NULL;
+}
+
+
 /****************************************************************************************/
 /* Exported functions                                                                   */
 /****************************************************************************************/
 
+/**
+ * Set SPI device ioctl function, used to replace spidev by a stand-in (simulator, tests, benchmarks)
+ * @param func ioctl function, same behavior as ioctl, NULL to use spidev again
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_set_ioctl(int (*func)(int fd, unsigned long request, void *arg)) {
+
+    sunxi_spi_ioctl = (func != NULL) ? func : sunxi_spi_ioctl_default;
+    return 0;
+}
+
 /**
  * Open SPI device, to be called once
  * @param filename /dev/spidev*.* path
@@ -36,7 +414,7 @@ int sunxi_spi_open(char* filename) {
 int sunxi_spi_read_mode(int fd, __u8 *mode) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_RD_MODE, mode)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_RD_MODE, mode)) < 0) {
         return errno;
     }
     return r;
@@ -51,7 +429,7 @@ int sunxi_spi_read_mode(int fd, __u8 *mode) {
 int sunxi_spi_write_mode(int fd, __u8 mode) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_WR_MODE, &mode)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_WR_MODE, &mode)) < 0) {
         return errno;
     }
     return r;
@@ -66,7 +444,7 @@ int sunxi_spi_write_mode(int fd, __u8 mode) {
 int sunxi_spi_read_mode32(int fd, __u32 *mode) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_RD_MODE32, mode)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_RD_MODE32, mode)) < 0) {
         return errno;
     }
     return r;
@@ -81,7 +459,7 @@ int sunxi_spi_read_mode32(int fd, __u32 *mode) {
 int sunxi_spi_write_mode32(int fd, __u32 mode) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_WR_MODE32, &mode)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_WR_MODE32, &mode)) < 0) {
         return errno;
     }
     return r;
@@ -96,7 +474,7 @@ int sunxi_spi_write_mode32(int fd, __u32 mode) {
 int sunxi_spi_read_lsb(int fd, __u8 *lsb) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_RD_LSB_FIRST, lsb)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_RD_LSB_FIRST, lsb)) < 0) {
         return errno;
     }
     return r;
@@ -111,7 +489,7 @@ int sunxi_spi_read_lsb(int fd, __u8 *lsb) {
 int sunxi_spi_write_lsb(int fd, __u8 lsb) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_WR_LSB_FIRST, &lsb)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_WR_LSB_FIRST, &lsb)) < 0) {
         return errno;
     }
     return r;
@@ -126,7 +504,7 @@ int sunxi_spi_write_lsb(int fd, __u8 lsb) {
 int sunxi_spi_read_bits(int fd, __u8 *bits) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, bits)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, bits)) < 0) {
         return errno;
     }
     return r;
@@ -141,7 +519,7 @@ int sunxi_spi_read_bits(int fd, __u8 *bits) {
 int sunxi_spi_write_bits(int fd, __u8 bits) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits)) < 0) {
         return errno;
     }
     return r;
@@ -156,7 +534,7 @@ int sunxi_spi_write_bits(int fd, __u8 bits) {
 int sunxi_spi_read_max_speed(int fd, __u32 *speed) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, speed)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, speed)) < 0) {
         return errno;
     }
     return r;
@@ -171,7 +549,7 @@ int sunxi_spi_read_max_speed(int fd, __u32 *speed) {
 int sunxi_spi_write_max_speed(int fd, __u32 speed) {
     
     int r;
-    if ((r = ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed)) < 0) {
         return errno;
     }
     return r;
@@ -211,12 +589,358 @@ int sunxi_spi_transfer_speed_delay_cs(int fd, unsigned char *tx, unsigned char *
     ioc_transfer.speed_hz = speed;
     ioc_transfer.delay_usecs = delay_usecs;
     ioc_transfer.cs_change = cs_change;
-    if ((r = ioctl(fd, SPI_IOC_MESSAGE(1), &ioc_transfer)) < 0) {
+    if ((r = sunxi_spi_ioctl(fd, SPI_IOC_MESSAGE(1), &ioc_transfer)) < 0) {
         return errno;
     }
     return r;
 }
 
+/**
+ * Perform SPI device transfer of several segments in a single message (single ioctl)
+ * CS is kept asserted between the segments, unless cs_change is set on a segment.
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param segments Segments to be transferred
+ * @param count Number of segments, maximal number is SUNXI_SPI_SEGMENTS_MAX
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_transfer_segments(int fd, struct sunxi_spi_segment *segments, unsigned int count) {
+
+    if ((count == 0) || (count > SUNXI_SPI_SEGMENTS_MAX)) {
+        return EINVAL;
+    }
+    return sunxi_spi_segments_submit(fd, segments, count);
+}
+
+/**
+ * Initialize SPI message, the transfers array is reused by all the messages built
+ * @param message Message to be initialized
+ * @param transfers Preallocated transfers array
+ * @param max Number of transfers of the array, maximal number is SUNXI_SPI_SEGMENTS_MAX
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_message_init(struct sunxi_spi_message *message, struct spi_ioc_transfer *transfers, unsigned int max) {
+
+    if ((transfers == NULL) || (max == 0) || (max > SUNXI_SPI_SEGMENTS_MAX)) {
+        return EINVAL;
+    }
+    message->transfers = transfers;
+    message->count = 0;
+    message->max = max;
+    return 0;
+}
+
+/**
+ * Reset SPI message, to build a new message
+ * @param message Message to be reset
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_message_reset(struct sunxi_spi_message *message) {
+
+    message->count = 0;
+    return 0;
+}
+
+/**
+ * Add segment to SPI message
+ * @param message Message to be completed
+ * @param tx Data to be written to the SPi interface, NULL if not defined
+ * @param rx Data to be read from the SPi interface, NULL if not defined
+ * @param len Length of data to be writen/read
+ * @param speed Speed of SPI interface, 32bits format (Hz), 0 to use max speed
+ * @param bits Bits per word, 0 to use the device setting
+ * @param delay_usecs Delay after the segment, before the next segment or the release of CS line, 0 if not used
+ * @param cs_change CS behavior, 1 to release CS after the segment (not released after the last segment), 0 otherwise
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_message_add(struct sunxi_spi_message *message, unsigned char *tx, unsigned char *rx, __u32 len, __u32 speed, __u8 bits, __u16 delay_usecs, __u8 cs_change) {
+
+    struct spi_ioc_transfer *ioc_transfer;
+
+    if (message->count >= message->max) {
+        return ENOSPC;
+    }
+    ioc_transfer = &message->transfers[message->count++];
+    memset(ioc_transfer, 0, sizeof(struct spi_ioc_transfer));
+    ioc_transfer->tx_buf = (unsigned long)tx;
+    ioc_transfer->rx_buf = (unsigned long)rx;
+    ioc_transfer->len = len;
+    ioc_transfer->speed_hz = speed;
+    ioc_transfer->bits_per_word = bits;
+    ioc_transfer->delay_usecs = delay_usecs;
+    ioc_transfer->cs_change = cs_change;
+    return 0;
+}
+
+/**
+ * Perform SPI device transfer of a message in a single ioctl
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param message Message to be transferred
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_message_submit(int fd, struct sunxi_spi_message *message) {
+
+    if (message->count == 0) {
+        return EINVAL;
+    }
+    if (sunxi_spi_ioctl(fd, SPI_IOC_MESSAGE(message->count), message->transfers) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+/**
+ * Get spidev buffer size, maximal size of a message
+ * @param bufsiz spidev buffer size, read from the spidev module parameters, SUNXI_SPI_BUFSIZ if not available
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_get_bufsiz(__u32 *bufsiz) {
+
+    FILE *file;
+    unsigned long value;
+
+    pthread_mutex_lock(&sunxi_spi_sizes_mutex);
+    if (sunxi_spi_bufsiz == 0) {
+        sunxi_spi_bufsiz = SUNXI_SPI_BUFSIZ;
+        if ((file = fopen("/sys/module/spidev/parameters/bufsiz", "r")) != NULL) {
+            if ((fscanf(file, "%lu", &value) == 1) && (value > 0)) {
+                sunxi_spi_bufsiz = value;
+            }
+            fclose(file);
+        }
+    }
+    *bufsiz = sunxi_spi_bufsiz;
+    pthread_mutex_unlock(&sunxi_spi_sizes_mutex);
+    return 0;
+}
+
+/**
+ * Reserve a transfer in the spidev buffers of a message, spidev rounding the tx and rx lengths of
+ * each transfer to SUNXI_SPI_BUFSIZ_ALIGN and checking the tx and rx totals separately
+ * @param tx_total Rounded tx length of the message, updated if the transfer fits
+ * @param rx_total Rounded rx length of the message, updated if the transfer fits
+ * @param tx 1 if the transfer has tx data, 0 otherwise
+ * @param rx 1 if the transfer has rx data, 0 otherwise
+ * @param len Length of the transfer
+ * @param bufsiz spidev buffer size
+ * @return 0 if the transfer fits, EMSGSIZE otherwise
+ */
+int sunxi_spi_buffer_reserve(__u32 *tx_total, __u32 *rx_total, int tx, int rx, __u32 len, __u32 bufsiz) {
+
+    __u64 aligned = ((__u64)len + SUNXI_SPI_BUFSIZ_ALIGN - 1) & ~((__u64)SUNXI_SPI_BUFSIZ_ALIGN - 1);
+
+    if ((tx && (*tx_total + aligned > bufsiz)) || (rx && (*rx_total + aligned > bufsiz))) {
+        return EMSGSIZE;
+    }
+    if (tx) *tx_total += aligned;
+    if (rx) *rx_total += aligned;
+    return 0;
+}
+
+/**
+ * Get segment size of large transfers
+ * Drivers of kernels older than 5.0 do not refill the controller FIFO, the segments are then limited
+ * to the FIFO size of the SoC (64 bytes on SUN4I/SUN5I/SUN7I, 128 bytes on SUN6I/SUN8I), the spidev
+ * buffer size is used otherwise.
+ * @param size Segment size
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_get_segment_size(__u32 *size) {
+
+    struct utsname name;
+    char compatible[256];
+    size_t len, index;
+    int fd;
+    __u32 bufsiz;
+
+    sunxi_spi_get_bufsiz(&bufsiz);
+    pthread_mutex_lock(&sunxi_spi_sizes_mutex);
+    if (sunxi_spi_segment_size == 0) {
+        sunxi_spi_segment_size = bufsiz;
+        if ((uname(&name) == 0) && (atoi(name.release) < 5)) {
+            if ((fd = open("/proc/device-tree/compatible", O_RDONLY)) >= 0) {
+                len = read(fd, compatible, sizeof(compatible) - 1);
+                close(fd);
+                if (len > 0 && len < sizeof(compatible)) {
+                    /* Compatible strings are NUL separated */
+                    for (index = 0; index < len; index++) {
+                        if (compatible[index] == 0) compatible[index] = ' ';
+                    }
+                    compatible[len] = 0;
+                    if (strstr(compatible, "sun4i") || strstr(compatible, "sun5i") || strstr(compatible, "sun7i")) {
+                        sunxi_spi_segment_size = SUNXI_SPI_SUN4I_FIFO_SIZE;
+                    } else if (strstr(compatible, "sun6i") || strstr(compatible, "sun8i")) {
+                        sunxi_spi_segment_size = SUNXI_SPI_SUN6I_FIFO_SIZE;
+                    }
+                }
+            }
+        }
+    }
+    *size = sunxi_spi_segment_size;
+    pthread_mutex_unlock(&sunxi_spi_sizes_mutex);
+    return 0;
+}
+
+/**
+ * Set segment size of large transfers
+ * @param size Segment size, 0 to detect it again
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_set_segment_size(__u32 size) {
+
+    pthread_mutex_lock(&sunxi_spi_sizes_mutex);
+    sunxi_spi_segment_size = size;
+    pthread_mutex_unlock(&sunxi_spi_sizes_mutex);
+    return 0;
+}
+
+/**
+ * Perform SPI device transfer of any length
+ * The data are split in segments (see sunxi_spi_get_segment_size), grouped in as few messages as
+ * possible (limited by the spidev buffer size), CS is kept asserted during the whole transfer.
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param tx Data to be written to the SPi interface, NULL if not defined
+ * @param rx Data to be read from the SPi interface, NULL if not defined
+ * @param len Length of data to be writen/read
+ * @param speed Speed of SPI interface, 32bits format (Hz), 0 to use max speed
+ * @param bits Bits per word, 0 to use the device setting
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_transfer_large(int fd, unsigned char *tx, unsigned char *rx, __u32 len, __u32 speed, __u8 bits) {
+
+    __u32 bufsiz, segment_size, count;
+
+    sunxi_spi_get_bufsiz(&bufsiz);
+    sunxi_spi_get_segment_size(&segment_size);
+    if (segment_size > bufsiz) {
+        segment_size = bufsiz;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    /* Segments per message, limited by the spidev buffer (rounded segments) and by the transfer length */
+    count = bufsiz / ((segment_size + SUNXI_SPI_BUFSIZ_ALIGN - 1) & ~(SUNXI_SPI_BUFSIZ_ALIGN - 1));
+    if (count == 0) {
+        count = 1;
+    }
+    if (count > SUNXI_SPI_SEGMENTS_MAX) {
+        count = SUNXI_SPI_SEGMENTS_MAX;
+    }
+    if (count > (len - 1) / segment_size + 1) {
+        count = (len - 1) / segment_size + 1;
+    }
+    return sunxi_spi_large_submit(fd, tx, rx, len, speed, bits, segment_size, count);
+}
+
+/**
+ * Open SPI asynchronous queue, start its worker thread
+ * The eventfd queue->efd is incremented by the number of requests completed, it can be polled
+ * instead of using callbacks.
+ * @param queue SPI queue
+ * @param fd File descriptor get from sunxi_spi_open
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_queue_open(struct sunxi_spi_queue *queue, int fd) {
+
+    int result;
+
+    memset(queue, 0, sizeof(struct sunxi_spi_queue));
+    queue->fd = fd;
+    if ((queue->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        return errno;
+    }
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->running = 1;
+    if ((result = pthread_create(&queue->thread, NULL, sunxi_spi_queue_thread, queue)) != 0) {
+        pthread_cond_destroy(&queue->cond);
+        pthread_mutex_destroy(&queue->mutex);
+        close(queue->efd);
+        return result;
+    }
+    return 0;
+}
+
+/**
+ * Submit request to SPI asynchronous queue, wait for a free slot if the queue is full
+ * Requests are transferred in order; as for a single message, CS is released after a request
+ * unless cs_change is set. The buffers must stay valid until the request is completed.
+ * @param queue SPI queue
+ * @param tx Data to be written to the SPi interface, NULL if not defined
+ * @param rx Data to be read from the SPi interface, NULL if not defined
+ * @param len Length of data to be writen/read
+ * @param speed Speed of SPI interface, 32bits format (Hz), 0 to use the device setting
+ * @param bits Bits per word, 0 to use the device setting
+ * @param cs_change 1 to keep CS asserted after the request, 0 otherwise
+ * @param callback Completion callback, called from the worker thread with the transfer status, NULL if not used
+ * @param arg Callback argument
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_queue_submit(struct sunxi_spi_queue *queue, unsigned char *tx, unsigned char *rx, __u32 len, __u32 speed, __u8 bits, __u8 cs_change, void (*callback)(void *arg, int status), void *arg) {
+
+    struct sunxi_spi_request *request;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->running && (queue->count == SUNXI_SPI_QUEUE_SIZE)) {
+        pthread_cond_wait(&queue->cond, &queue->mutex);
+    }
+    if (!queue->running) {
+        pthread_mutex_unlock(&queue->mutex);
+        return EPIPE;
+    }
+    request = &queue->requests[(queue->head + queue->count) % SUNXI_SPI_QUEUE_SIZE];
+    memset(request, 0, sizeof(struct sunxi_spi_request));
+    request->segment.tx = tx;
+    request->segment.rx = rx;
+    request->segment.len = len;
+    request->segment.speed = speed;
+    request->segment.bits = bits;
+    request->segment.cs_change = cs_change;
+    request->callback = callback;
+    request->arg = arg;
+    queue->count++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+/**
+ * Wait for the completion of all the requests submitted to SPI asynchronous queue
+ * @param queue SPI queue
+ * @return 0 if all the requests completed since the previous flush succeeded, first error code otherwise
+ */
+int sunxi_spi_queue_flush(struct sunxi_spi_queue *queue) {
+
+    int status;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count > 0) {
+        pthread_cond_wait(&queue->cond, &queue->mutex);
+    }
+    status = queue->status;
+    queue->status = 0;
+    pthread_mutex_unlock(&queue->mutex);
+    return status;
+}
+
+/**
+ * Close SPI asynchronous queue, the pending requests are completed before the worker thread stops
+ * @param queue SPI queue
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_queue_close(struct sunxi_spi_queue *queue) {
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->running = 0;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    pthread_join(queue->thread, NULL);
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    close(queue->efd);
+    return 0;
+}
+
 /**
  * Close SPI device
  * @param fd File descriptor get from sunxi_spi_open
@@ -226,3 +950,558 @@ int sunxi_spi_close(int fd) {
     
     return close(fd);
 }
+
+/**
+ * Open SPI device handle, the current settings of the device are read and cached
+ * @param device SPI device handle
+ * @param filename Device filename (/dev/spidevX.X)
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_device_open(struct sunxi_spi_device *device, char *filename) {
+
+    int result;
+
+    memset(device, 0, sizeof(struct sunxi_spi_device));
+    if ((device->fd = open(filename, O_RDWR)) < 0) {
+        return errno;
+    }
+    if (((result = sunxi_spi_read_mode(device->fd, &device->mode)) != 0) ||
+        ((result = sunxi_spi_read_bits(device->fd, &device->bits)) != 0) ||
+        ((result = sunxi_spi_read_max_speed(device->fd, &device->speed)) != 0)) {
+        sunxi_spi_close(device->fd);
+        device->fd = -1;
+        return result;
+    }
+    return 0;
+}
+
+/**
+ * Configure SPI device, only the settings that differ from the cached ones are written
+ * @param device SPI device handle
+ * @param mode SPI mode (SPI_MODE_X and flags)
+ * @param bits Bits per word
+ * @param speed Max speed, 32bits format (Hz)
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_device_configure(struct sunxi_spi_device *device, __u8 mode, __u8 bits, __u32 speed) {
+
+    int result;
+
+    if (mode != device->mode) {
+        if ((result = sunxi_spi_write_mode(device->fd, mode)) != 0) {
+            return result;
+        }
+        device->mode = mode;
+    }
+    if (bits != device->bits) {
+        if ((result = sunxi_spi_write_bits(device->fd, bits)) != 0) {
+            return result;
+        }
+        device->bits = bits;
+    }
+    if (speed != device->speed) {
+        if ((result = sunxi_spi_write_max_speed(device->fd, speed)) != 0) {
+            return result;
+        }
+        device->speed = speed;
+    }
+    return 0;
+}
+
+/**
+ * Perform SPI device transfer with the device settings
+ * @param device SPI device handle
+ * @param tx Data to be written to the SPi interface, NULL if not defined
+ * @param rx Data to be read from the SPi interface, NULL if not defined
+ * @param len Length of data to be writen/read
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_device_transfer(struct sunxi_spi_device *device, unsigned char *tx, unsigned char *rx, __u32 len) {
+
+    struct sunxi_spi_segment segment;
+
+    memset(&segment, 0, sizeof(struct sunxi_spi_segment));
+    segment.tx = tx;
+    segment.rx = rx;
+    segment.len = len;
+    return sunxi_spi_transfer_segments(device->fd, &segment, 1);
+}
+
+/**
+ * Perform SPI device transfer of several segments in a single message
+ * Speed and bits of a segment override the device settings for this segment only, without ioctl.
+ * @param device SPI device handle
+ * @param segments Segments to be transferred
+ * @param count Number of segments
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_device_transfer_segments(struct sunxi_spi_device *device, struct sunxi_spi_segment *segments, unsigned int count) {
+
+    return sunxi_spi_transfer_segments(device->fd, segments, count);
+}
+
+/**
+ * Close SPI device handle
+ * @param device SPI device handle
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_device_close(struct sunxi_spi_device *device) {
+
+    int result;
+
+    result = sunxi_spi_close(device->fd);
+    device->fd = -1;
+    return result;
+}
+
+/**
+ * Initialize SPI bus arbiter
+ * @param bus SPI bus
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_bus_init(struct sunxi_spi_bus *bus) {
+
+    memset(bus, 0, sizeof(struct sunxi_spi_bus));
+    pthread_mutex_init(&bus->mutex, NULL);
+    pthread_cond_init(&bus->cond, NULL);
+    return 0;
+}
+
+/**
+ * Add client to SPI bus arbiter
+ * @param bus SPI bus
+ * @param client SPI bus client, valid until the bus is deinitialized
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param priority Priority of the client jobs, highest first
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_bus_add_client(struct sunxi_spi_bus *bus, struct sunxi_spi_bus_client *client, int fd, int priority) {
+
+    pthread_mutex_lock(&bus->mutex);
+    if (bus->count == SUNXI_SPI_BUS_CLIENTS_MAX) {
+        pthread_mutex_unlock(&bus->mutex);
+        return ENOSPC;
+    }
+    memset(client, 0, sizeof(struct sunxi_spi_bus_client));
+    client->bus = bus;
+    client->fd = fd;
+    client->priority = priority;
+    bus->clients[bus->count++] = client;
+    pthread_mutex_unlock(&bus->mutex);
+    return 0;
+}
+
+/**
+ * Perform SPI bus transfer of several segments, waiting for the bus to be granted
+ * A non preemptible job is transferred in a single message, CS is kept asserted between the segments.
+ * A preemptible job is transferred one segment per message (CS released between the segments, cs_change
+ * ignored), the bus being handed over at segment boundaries to the clients with precedence.
+ * @param client SPI bus client
+ * @param segments Segments to be transferred
+ * @param count Number of segments
+ * @param deadline Absolute deadline of the job (CLOCK_MONOTONIC), NULL if not defined
+ * @param preemptible 1 if the job can be preempted between segments, 0 otherwise
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_bus_transfer(struct sunxi_spi_bus_client *client, struct sunxi_spi_segment *segments, unsigned int count, struct timespec *deadline, int preemptible) {
+
+    struct sunxi_spi_bus *bus = client->bus;
+    struct sunxi_spi_segment segment;
+    struct timespec now;
+    unsigned long long wait;
+    unsigned int index;
+    int result = 0;
+
+    if ((count == 0) || (count > SUNXI_SPI_SEGMENTS_MAX)) {
+        return EINVAL;
+    }
+    pthread_mutex_lock(&bus->mutex);
+    if (deadline != NULL) {
+        client->deadline = *deadline;
+    } else {
+        memset(&client->deadline, 0, sizeof(struct timespec));
+    }
+    client->ticket = bus->ticket++;
+    wait = sunxi_spi_bus_acquire(client);
+    client->stats.jobs++;
+    client->stats.wait_total_ns += wait;
+    if (wait > client->stats.wait_max_ns) {
+        client->stats.wait_max_ns = wait;
+    }
+    if (deadline != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec > deadline->tv_sec) || ((now.tv_sec == deadline->tv_sec) && (now.tv_nsec > deadline->tv_nsec))) {
+            client->stats.deadline_misses++;
+        }
+    }
+    pthread_mutex_unlock(&bus->mutex);
+
+    if (!preemptible) {
+        result = sunxi_spi_transfer_segments(client->fd, segments, count);
+    } else {
+        for (index = 0; index < count; index++) {
+            segment = segments[index];
+            segment.cs_change = 0;
+            if ((result = sunxi_spi_transfer_segments(client->fd, &segment, 1)) != 0) {
+                break;
+            }
+            if (index < count - 1) {
+                pthread_mutex_lock(&bus->mutex);
+                if (sunxi_spi_bus_preceded(client)) {
+                    client->stats.preemptions++;
+                    sunxi_spi_bus_release(client);
+                    wait = sunxi_spi_bus_acquire(client);
+                    client->stats.preempt_wait_total_ns += wait;
+                    if (wait > client->stats.preempt_wait_max_ns) {
+                        client->stats.preempt_wait_max_ns = wait;
+                    }
+                }
+                pthread_mutex_unlock(&bus->mutex);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&bus->mutex);
+    sunxi_spi_bus_release(client);
+    pthread_mutex_unlock(&bus->mutex);
+    return result;
+}
+
+/**
+ * Get SPI bus client statistics
+ * @param client SPI bus client
+ * @param stats Statistics since the client was added or the previous reset
+ * @param reset 1 to reset the statistics, 0 otherwise
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_bus_get_stats(struct sunxi_spi_bus_client *client, struct sunxi_spi_bus_stats *stats, int reset) {
+
+    pthread_mutex_lock(&client->bus->mutex);
+    *stats = client->stats;
+    if (reset) {
+        memset(&client->stats, 0, sizeof(struct sunxi_spi_bus_stats));
+    }
+    pthread_mutex_unlock(&client->bus->mutex);
+    return 0;
+}
+
+/**
+ * Deinitialize SPI bus arbiter, no transfer must be in progress
+ * @param bus SPI bus
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_bus_deinit(struct sunxi_spi_bus *bus) {
+
+    pthread_cond_destroy(&bus->cond);
+    pthread_mutex_destroy(&bus->mutex);
+    bus->count = 0;
+    return 0;
+}
+
+/**
+ * Initialize SPI buffer pool, buffers are aligned on cache lines, prefaulted and locked in memory
+ * Locking requires CAP_IPC_LOCK or a sufficient RLIMIT_MEMLOCK, pool->locked is 0 if it failed.
+ * @param pool SPI buffer pool
+ * @param count Number of buffers
+ * @param buffer_size Size of the buffers, 0 to use the spidev buffer size
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_pool_init(struct sunxi_spi_pool *pool, unsigned int count, __u32 buffer_size) {
+
+    unsigned int index;
+    void *memory;
+    int result;
+
+    if (count == 0) {
+        return EINVAL;
+    }
+    memset(pool, 0, sizeof(struct sunxi_spi_pool));
+    if (buffer_size == 0) {
+        sunxi_spi_get_bufsiz(&buffer_size);
+    }
+    pool->buffer_size = (buffer_size + SUNXI_SPI_POOL_ALIGN - 1) & ~(SUNXI_SPI_POOL_ALIGN - 1);
+    pool->count = count;
+    pool->size = (size_t)pool->buffer_size * count;
+    if ((result = posix_memalign(&memory, sysconf(_SC_PAGESIZE), pool->size)) != 0) {
+        return result;
+    }
+    pool->free = malloc(sizeof(unsigned int) * count);
+    pool->used = calloc(count, sizeof(unsigned char));
+    if ((pool->free == NULL) || (pool->used == NULL)) {
+        free(pool->used);
+        free(pool->free);
+        free(memory);
+        return ENOMEM;
+    }
+    pool->memory = memory;
+    memset(pool->memory, 0, pool->size);
+    pool->locked = (mlock(pool->memory, pool->size) == 0);
+    for (index = 0; index < count; index++) {
+        pool->free[index] = count - 1 - index;
+    }
+    pool->free_count = count;
+    pthread_mutex_init(&pool->mutex, NULL);
+    return 0;
+}
+
+/**
+ * Get buffer from SPI buffer pool
+ * @param pool SPI buffer pool
+ * @return Buffer of pool->buffer_size bytes, NULL if the pool is exhausted
+ */
+unsigned char *sunxi_spi_pool_get(struct sunxi_spi_pool *pool) {
+
+    unsigned char *buffer = NULL;
+    unsigned int index;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->free_count > 0) {
+        index = pool->free[--pool->free_count];
+        pool->used[index] = 1;
+        buffer = pool->memory + (size_t)index * pool->buffer_size;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return buffer;
+}
+
+/**
+ * Put buffer back into SPI buffer pool
+ * @param pool SPI buffer pool
+ * @param buffer Buffer get from sunxi_spi_pool_get
+ * @return 0 if the function succeeds, EINVAL if the buffer is not in use (put twice), error code otherwise
+ */
+int sunxi_spi_pool_put(struct sunxi_spi_pool *pool, unsigned char *buffer) {
+
+    size_t offset;
+    unsigned int index;
+
+    if ((buffer < pool->memory) || (buffer >= pool->memory + pool->size)) {
+        return EINVAL;
+    }
+    offset = buffer - pool->memory;
+    if (offset % pool->buffer_size != 0) {
+        return EINVAL;
+    }
+    index = offset / pool->buffer_size;
+    pthread_mutex_lock(&pool->mutex);
+    if (!pool->used[index]) {
+        pthread_mutex_unlock(&pool->mutex);
+        return EINVAL;
+    }
+    pool->used[index] = 0;
+    pool->free[pool->free_count++] = index;
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+/**
+ * Perform SPI device transfer with pool buffers, without allocation
+ * The rx buffer is get from the pool and handed over to the caller, which can fill it as the next tx
+ * buffer; the tx buffer is put back into the pool once transferred if it belongs to the pool. For an
+ * in-place exchange, pass the same pool buffer as tx and rx of sunxi_spi_transfer.
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param pool SPI buffer pool
+ * @param tx Data to be written to the SPi interface, NULL if not defined
+ * @param rx Buffer get from the pool with the data read from the SPi interface, NULL if not defined
+ * @param len Length of data to be writen/read, up to pool->buffer_size
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_pool_transfer(int fd, struct sunxi_spi_pool *pool, unsigned char *tx, unsigned char **rx, __u32 len) {
+
+    struct sunxi_spi_segment segment;
+    int result;
+
+    if (len > pool->buffer_size) {
+        return EMSGSIZE;
+    }
+    memset(&segment, 0, sizeof(struct sunxi_spi_segment));
+    segment.tx = tx;
+    segment.len = len;
+    if (rx != NULL) {
+        if ((segment.rx = sunxi_spi_pool_get(pool)) == NULL) {
+            return ENOMEM;
+        }
+    }
+    if ((result = sunxi_spi_transfer_segments(fd, &segment, 1)) != 0) {
+        if (segment.rx != NULL) {
+            sunxi_spi_pool_put(pool, segment.rx);
+        }
+        return result;
+    }
+    if ((tx != NULL) && (tx >= pool->memory) && (tx < pool->memory + pool->size)) {
+        sunxi_spi_pool_put(pool, tx);
+    }
+    if (rx != NULL) {
+        *rx = segment.rx;
+    }
+    return 0;
+}
+
+/**
+ * Deinitialize SPI buffer pool, all the buffers are released
+ * @param pool SPI buffer pool
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_pool_deinit(struct sunxi_spi_pool *pool) {
+
+    if (pool->locked) {
+        munlock(pool->memory, pool->size);
+    }
+    free(pool->memory);
+    free(pool->free);
+    free(pool->used);
+    pthread_mutex_destroy(&pool->mutex);
+    memset(pool, 0, sizeof(struct sunxi_spi_pool));
+    return 0;
+}
+
+/**
+ * Start SPI full-duplex stream, buffers are transferred continuously by a worker thread
+ * Each buffer is a CS frame, the buffers are transferred by batches in a single message to minimize
+ * the gaps; the received buffers are queued in a ring of count buffers read by sunxi_spi_stream_read.
+ * @param stream SPI stream
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param len Length of a buffer
+ * @param count Number of buffers of the ring, at least 2 * batch (a batch read while the next one is transferred)
+ * @param batch Number of buffers transferred per message, fitting in the spidev buffers (see sunxi_spi_buffer_reserve)
+ * @param fill Function filling the tx buffer before its transfer, called from the worker thread, NULL to send zeros
+ * @param arg Fill function argument
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_stream_start(struct sunxi_spi_stream *stream, int fd, __u32 len, unsigned int count, unsigned int batch, void (*fill)(void *arg, unsigned char *tx, __u32 len), void *arg) {
+
+    unsigned int index;
+    __u32 bufsiz, tx_total = 0, rx_total = 0;
+    int result;
+
+    if ((len == 0) || (batch == 0) || (batch > SUNXI_SPI_SEGMENTS_MAX) || (count / 2 < batch)) {
+        return EINVAL;
+    }
+
+    /* Check that a batch fits in the spidev buffers, tx sent only with a fill function */
+    sunxi_spi_get_bufsiz(&bufsiz);
+    for (index = 0; index < batch; index++) {
+        if (sunxi_spi_buffer_reserve(&tx_total, &rx_total, fill != NULL, 1, len, bufsiz) != 0) {
+            return EINVAL;
+        }
+    }
+    memset(stream, 0, sizeof(struct sunxi_spi_stream));
+    stream->fd = fd;
+    stream->len = len;
+    stream->count = count;
+    stream->batch = batch;
+    stream->fill = fill;
+    stream->arg = arg;
+    if ((result = sunxi_spi_pool_init(&stream->pool, count * 2, len)) != 0) {
+        return result;
+    }
+    stream->tx = malloc(sizeof(unsigned char *) * count);
+    stream->rx = malloc(sizeof(unsigned char *) * count);
+    stream->transfers = calloc(batch, sizeof(struct spi_ioc_transfer));
+    if ((stream->tx == NULL) || (stream->rx == NULL) || (stream->transfers == NULL)) {
+        result = ENOMEM;
+        goto error;
+    }
+    for (index = 0; index < count; index++) {
+        stream->tx[index] = sunxi_spi_pool_get(&stream->pool);
+        stream->rx[index] = sunxi_spi_pool_get(&stream->pool);
+    }
+    pthread_mutex_init(&stream->mutex, NULL);
+    pthread_cond_init(&stream->cond, NULL);
+    stream->running = 1;
+    if ((result = pthread_create(&stream->thread, NULL, sunxi_spi_stream_thread, stream)) != 0) {
+        pthread_cond_destroy(&stream->cond);
+        pthread_mutex_destroy(&stream->mutex);
+        goto error;
+    }
+    return 0;
+
+error:
+    free(stream->transfers);
+    free(stream->rx);
+    free(stream->tx);
+    sunxi_spi_pool_deinit(&stream->pool);
+    return result;
+}
+
+/**
+ * Read the oldest received buffer of SPI stream
+ * @param stream SPI stream
+ * @param rx Data read from the SPI interface, stream->len bytes
+ * @param timeout_ms Timeout (ms), -1 to wait indefinitely
+ * @return 0 if the function succeeds, ETIMEDOUT if no buffer was received, transfer error code if the stream stopped
+ */
+int sunxi_spi_stream_read(struct sunxi_spi_stream *stream, unsigned char *rx, int timeout_ms) {
+
+    struct timespec deadline;
+    int result = 0;
+
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    pthread_mutex_lock(&stream->mutex);
+    while ((stream->ready == 0) && stream->running && (result == 0)) {
+        if (timeout_ms >= 0) {
+            result = pthread_cond_timedwait(&stream->cond, &stream->mutex, &deadline);
+        } else {
+            pthread_cond_wait(&stream->cond, &stream->mutex);
+        }
+    }
+    if (stream->ready > 0) {
+        memcpy(rx, stream->rx[stream->head], stream->len);
+        stream->head = (stream->head + 1) % stream->count;
+        stream->ready--;
+        result = 0;
+    } else if (!stream->running) {
+        result = (stream->status != 0) ? stream->status : EPIPE;
+    }
+    pthread_mutex_unlock(&stream->mutex);
+    return result;
+}
+
+/**
+ * Get SPI stream statistics
+ * @param stream SPI stream
+ * @param buffers Number of buffers received, NULL if not used
+ * @param overruns Number of buffers dropped before being read, NULL if not used
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_stream_get_stats(struct sunxi_spi_stream *stream, unsigned long long *buffers, unsigned long long *overruns) {
+
+    pthread_mutex_lock(&stream->mutex);
+    if (buffers != NULL) {
+        *buffers = stream->buffers;
+    }
+    if (overruns != NULL) {
+        *overruns = stream->overruns;
+    }
+    pthread_mutex_unlock(&stream->mutex);
+    return 0;
+}
+
+/**
+ * Stop SPI stream, the batch in progress is completed
+ * @param stream SPI stream
+ * @return 0 if the stream ran without error, transfer error code otherwise
+ */
+int sunxi_spi_stream_stop(struct sunxi_spi_stream *stream) {
+
+    pthread_mutex_lock(&stream->mutex);
+    stream->running = 0;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+    pthread_join(stream->thread, NULL);
+    pthread_cond_destroy(&stream->cond);
+    pthread_mutex_destroy(&stream->mutex);
+    free(stream->transfers);
+    free(stream->rx);
+    free(stream->tx);
+    sunxi_spi_pool_deinit(&stream->pool);
+    return stream->status;
+}
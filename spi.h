@@ -18,14 +18,178 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/utsname.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <time.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 
 
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* SUNXI SPI maximum number of segments of a message, limited by the ioctl size field */
+#define SUNXI_SPI_SEGMENTS_MAX                  ((_IOC_SIZEMASK) / sizeof(struct spi_ioc_transfer))
+
+/* SUNXI SPI number of segments of a message built on the stack, larger messages being allocated */
+#define SUNXI_SPI_SEGMENTS_STACK                64
+
+/* SUNXI SPI default spidev buffer size, maximal size of a message */
+#define SUNXI_SPI_BUFSIZ                        4096
+
+/* SUNXI SPI rounding of the transfer lengths in the spidev buffers (ARCH_KMALLOC_MINALIGN on ARM) */
+#define SUNXI_SPI_BUFSIZ_ALIGN                  64
+
+/* SUNXI SPI controller FIFO size, maximal size of a segment with drivers not refilling the FIFO */
+#define SUNXI_SPI_SUN4I_FIFO_SIZE               64
+#define SUNXI_SPI_SUN6I_FIFO_SIZE               128
+
+/* SUNXI SPI asynchronous queue size, maximal number of requests queued or in flight */
+#define SUNXI_SPI_QUEUE_SIZE                    64
+
+/* SUNXI SPI bus maximum number of clients */
+#define SUNXI_SPI_BUS_CLIENTS_MAX               16
+
+/* SUNXI SPI buffer pool alignment, cache line size */
+#define SUNXI_SPI_POOL_ALIGN                    64
+
+
+/****************************************************************************************/
+/* Types                                                                                */
+/****************************************************************************************/
+
+/* SUNXI SPI transfer segment, 0 speed and bits to use the device settings */
+struct sunxi_spi_segment {
+    unsigned char *tx;
+    unsigned char *rx;
+    __u32 len;
+    __u32 speed;
+    __u8 bits;
+    __u16 delay_usecs;
+    __u8 cs_change;
+};
+
+/* SUNXI SPI message, segments built in a preallocated array and submitted at once */
+struct sunxi_spi_message {
+    struct spi_ioc_transfer *transfers;
+    unsigned int count;
+    unsigned int max;
+};
+
+/* SUNXI SPI device handle, caches the settings applied to the device to skip unchanged ioctls */
+struct sunxi_spi_device {
+    int fd;
+    __u8 mode;
+    __u8 bits;
+    __u32 speed;
+};
+
+/* SUNXI SPI asynchronous request, callback called from the queue worker thread once completed */
+struct sunxi_spi_request {
+    struct sunxi_spi_segment segment;
+    void (*callback)(void *arg, int status);
+    void *arg;
+};
+
+/* SUNXI SPI asynchronous queue, requests coalesced by the worker thread in multi-transfer messages */
+struct sunxi_spi_queue {
+    int fd;
+    int efd;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int running;
+    int status;
+    unsigned int head;
+    unsigned int count;
+    struct sunxi_spi_request requests[SUNXI_SPI_QUEUE_SIZE];
+    struct spi_ioc_transfer transfers[SUNXI_SPI_QUEUE_SIZE];
+};
+
+
+/* SUNXI SPI bus client statistics, wait times from job submission to bus grant (per job), and from
+   preemption to bus grant back (per preemption) */
+struct sunxi_spi_bus_stats {
+    unsigned long long jobs;
+    unsigned long long preemptions;
+    unsigned long long deadline_misses;
+    unsigned long long wait_total_ns;
+    unsigned long long wait_max_ns;
+    unsigned long long preempt_wait_total_ns;
+    unsigned long long preempt_wait_max_ns;
+};
+
+struct sunxi_spi_bus;
+
+/* SUNXI SPI bus client, a device sharing the bus, one job at a time */
+struct sunxi_spi_bus_client {
+    struct sunxi_spi_bus *bus;
+    int fd;
+    int priority;
+    int waiting;
+    unsigned long long ticket;
+    struct timespec deadline;
+    struct sunxi_spi_bus_stats stats;
+};
+
+/* SUNXI SPI bus arbiter, grants the bus to the highest priority, then earliest deadline, then oldest job */
+struct sunxi_spi_bus {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct sunxi_spi_bus_client *owner;
+    struct sunxi_spi_bus_client *clients[SUNXI_SPI_BUS_CLIENTS_MAX];
+    unsigned int count;
+    unsigned long long ticket;
+};
+
+/* SUNXI SPI buffer pool, preallocated aligned buffers locked in memory */
+struct sunxi_spi_pool {
+    unsigned char *memory;
+    size_t size;
+    __u32 buffer_size;
+    unsigned int count;
+    unsigned int *free;
+    unsigned int free_count;
+    unsigned char *used;
+    int locked;
+    pthread_mutex_t mutex;
+};
+
+/* SUNXI SPI full-duplex stream, buffers transferred back-to-back by a worker thread into a ring */
+struct sunxi_spi_stream {
+    int fd;
+    __u32 len;
+    unsigned int count;
+    unsigned int batch;
+    void (*fill)(void *arg, unsigned char *tx, __u32 len);
+    void *arg;
+    struct sunxi_spi_pool pool;
+    unsigned char **tx;
+    unsigned char **rx;
+    struct spi_ioc_transfer *transfers;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int running;
+    int status;
+    unsigned int head;
+    unsigned int ready;
+    unsigned int next;
+    unsigned long long buffers;
+    unsigned long long overruns;
+};
+
+
 /****************************************************************************************/
 /* Prototypes                                                                           */
 /****************************************************************************************/
 
+int sunxi_spi_set_ioctl(int (*func)(int fd, unsigned long request, void *arg));
 int sunxi_spi_open(char* filename);
 int sunxi_spi_read_mode(int fd, __u8 *mode);
 int sunxi_spi_write_mode(int fd, __u8 mode);
@@ -39,7 +203,40 @@ int sunxi_spi_read_max_speed(int fd, __u32 *speed);
 int sunxi_spi_write_max_speed(int fd, __u32 speed);
 int sunxi_spi_transfer(int fd, unsigned char *tx, unsigned char *rx, __u32 len);
 int sunxi_spi_transfer_speed_delay_cs(int fd, unsigned char *tx, unsigned char *rx, __u32 len, __u32 speed, __u16 delay_usecs, __u8 cs_change);
+int sunxi_spi_transfer_segments(int fd, struct sunxi_spi_segment *segments, unsigned int count);
+int sunxi_spi_message_init(struct sunxi_spi_message *message, struct spi_ioc_transfer *transfers, unsigned int max);
+int sunxi_spi_message_reset(struct sunxi_spi_message *message);
+int sunxi_spi_message_add(struct sunxi_spi_message *message, unsigned char *tx, unsigned char *rx, __u32 len, __u32 speed, __u8 bits, __u16 delay_usecs, __u8 cs_change);
+int sunxi_spi_message_submit(int fd, struct sunxi_spi_message *message);
+int sunxi_spi_get_bufsiz(__u32 *bufsiz);
+int sunxi_spi_buffer_reserve(__u32 *tx_total, __u32 *rx_total, int tx, int rx, __u32 len, __u32 bufsiz);
+int sunxi_spi_get_segment_size(__u32 *size);
+int sunxi_spi_set_segment_size(__u32 size);
+int sunxi_spi_transfer_large(int fd, unsigned char *tx, unsigned char *rx, __u32 len, __u32 speed, __u8 bits);
+int sunxi_spi_queue_open(struct sunxi_spi_queue *queue, int fd);
+int sunxi_spi_queue_submit(struct sunxi_spi_queue *queue, unsigned char *tx, unsigned char *rx, __u32 len, __u32 speed, __u8 bits, __u8 cs_change, void (*callback)(void *arg, int status), void *arg);
+int sunxi_spi_queue_flush(struct sunxi_spi_queue *queue);
+int sunxi_spi_queue_close(struct sunxi_spi_queue *queue);
 int sunxi_spi_close(int fd);
+int sunxi_spi_device_open(struct sunxi_spi_device *device, char *filename);
+int sunxi_spi_device_configure(struct sunxi_spi_device *device, __u8 mode, __u8 bits, __u32 speed);
+int sunxi_spi_device_transfer(struct sunxi_spi_device *device, unsigned char *tx, unsigned char *rx, __u32 len);
+int sunxi_spi_device_transfer_segments(struct sunxi_spi_device *device, struct sunxi_spi_segment *segments, unsigned int count);
+int sunxi_spi_device_close(struct sunxi_spi_device *device);
+int sunxi_spi_bus_init(struct sunxi_spi_bus *bus);
+int sunxi_spi_bus_add_client(struct sunxi_spi_bus *bus, struct sunxi_spi_bus_client *client, int fd, int priority);
+int sunxi_spi_bus_transfer(struct sunxi_spi_bus_client *client, struct sunxi_spi_segment *segments, unsigned int count, struct timespec *deadline, int preemptible);
+int sunxi_spi_bus_get_stats(struct sunxi_spi_bus_client *client, struct sunxi_spi_bus_stats *stats, int reset);
+int sunxi_spi_bus_deinit(struct sunxi_spi_bus *bus);
+int sunxi_spi_pool_init(struct sunxi_spi_pool *pool, unsigned int count, __u32 buffer_size);
+unsigned char *sunxi_spi_pool_get(struct sunxi_spi_pool *pool);
+int sunxi_spi_pool_put(struct sunxi_spi_pool *pool, unsigned char *buffer);
+int sunxi_spi_pool_transfer(int fd, struct sunxi_spi_pool *pool, unsigned char *tx, unsigned char **rx, __u32 len);
+int sunxi_spi_pool_deinit(struct sunxi_spi_pool *pool);
+int sunxi_spi_stream_start(struct sunxi_spi_stream *stream, int fd, __u32 len, unsigned int count, unsigned int batch, void (*fill)(void *arg, unsigned char *tx, __u32 len), void *arg);
+int sunxi_spi_stream_read(struct sunxi_spi_stream *stream, unsigned char *rx, int timeout_ms);
+int sunxi_spi_stream_get_stats(struct sunxi_spi_stream *stream, unsigned long long *buffers, unsigned long long *overruns);
+int sunxi_spi_stream_stop(struct sunxi_spi_stream *stream);
 
 
 #endif
@@ -0,0 +1,309 @@
+/****************************************************************************************/
+/* SUNXI SPI display library interface                                                  */
+/****************************************************************************************/
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include "spi_display.h"
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Convert RGB888 pixels to RGB565 big endian pixels, 8 pixels per iteration on NEON cores
+ * @param dst RGB565 pixels
+ * @param src RGB888 pixels
+ * @param count Number of pixels
+ */
+static void sunxi_spi_display_convert(unsigned char *dst, const unsigned char *src, unsigned int count) {
+
+    unsigned int index = 0;
+#ifdef __ARM_NEON
+    uint8x8x3_t rgb;
+    uint8x8x2_t pixels;
+
+    for (; index + 8 <= count; index += 8) {
+        rgb = vld3_u8(src + index * 3);
+        pixels.val[0] = vorr_u8(vand_u8(rgb.val[0], vdup_n_u8(0xF8)), vshr_n_u8(rgb.val[1], 5));
+        pixels.val[1] = vorr_u8(vand_u8(vshl_n_u8(rgb.val[1], 3), vdup_n_u8(0xE0)), vshr_n_u8(rgb.val[2], 3));
+        vst2_u8(dst + index * 2, pixels);
+    }
+#endif
+    for (; index < count; index++) {
+        dst[index * 2] = (src[index * 3] & 0xF8) | (src[index * 3 + 1] >> 5);
+        dst[index * 2 + 1] = ((src[index * 3 + 1] << 3) & 0xE0) | (src[index * 3 + 2] >> 3);
+    }
+}
+
+/**
+ * Write command or data to the display, D/C pin set accordingly
+ * @param display SPI display
+ * @param data Data to be written
+ * @param len Length of data
+ * @param dc 0 for a command, 1 for data
+ * @return 0 if the function succeeds, error code otherwise
+ */
+static int sunxi_spi_display_write(struct sunxi_spi_display *display, unsigned char *data, __u32 len, unsigned int dc) {
+
+    int result;
+
+    if ((result = sunxi_gpio_output(display->dc_pin, dc)) < 0) {
+        return -result;
+    }
+    return sunxi_spi_transfer_large(display->fd, data, NULL, len, display->speed, 0);
+}
+
+/**
+ * Get changed span of a display row, frame compared to the shadow
+ * @param display SPI display
+ * @param row Row
+ * @param x0 First changed column
+ * @param x1 Last changed column
+ * @return 1 if the row changed, 0 otherwise
+ */
+static int sunxi_spi_display_span(struct sunxi_spi_display *display, unsigned int row, unsigned int *x0, unsigned int *x1) {
+
+    unsigned char *frame = display->frame + row * display->width * SUNXI_SPI_DISPLAY_BPP;
+    unsigned char *shadow = display->shadow + row * display->width * SUNXI_SPI_DISPLAY_BPP;
+    unsigned int first, last;
+
+    if (display->full) {
+        *x0 = 0;
+        *x1 = display->width - 1;
+        return 1;
+    }
+    if (memcmp(frame, shadow, display->width * SUNXI_SPI_DISPLAY_BPP) == 0) {
+        return 0;
+    }
+    for (first = 0; memcmp(frame + first * SUNXI_SPI_DISPLAY_BPP, shadow + first * SUNXI_SPI_DISPLAY_BPP, SUNXI_SPI_DISPLAY_BPP) == 0; first++);
+    for (last = display->width - 1; memcmp(frame + last * SUNXI_SPI_DISPLAY_BPP, shadow + last * SUNXI_SPI_DISPLAY_BPP, SUNXI_SPI_DISPLAY_BPP) == 0; last--);
+    *x0 = first;
+    *x1 = last;
+    return 1;
+}
+
+/**
+ * Send display window, window set commands followed by the pixels, shadow updated
+ * @param display SPI display
+ * @param x0 First column
+ * @param y0 First row
+ * @param x1 Last column
+ * @param y1 Last row
+ * @return 0 if the function succeeds, error code otherwise
+ */
+static int sunxi_spi_display_window(struct sunxi_spi_display *display, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) {
+
+    unsigned char params[4];
+    unsigned int row, offset, width = (x1 - x0 + 1) * SUNXI_SPI_DISPLAY_BPP;
+    unsigned char *pixels;
+    __u32 len = 0;
+    int result;
+
+    params[0] = x0 >> 8;
+    params[1] = x0 & 0xFF;
+    params[2] = x1 >> 8;
+    params[3] = x1 & 0xFF;
+    if ((result = sunxi_spi_display_command(display, SUNXI_SPI_DISPLAY_CMD_CASET, params, 4)) != 0) {
+        return result;
+    }
+    params[0] = y0 >> 8;
+    params[1] = y0 & 0xFF;
+    params[2] = y1 >> 8;
+    params[3] = y1 & 0xFF;
+    if ((result = sunxi_spi_display_command(display, SUNXI_SPI_DISPLAY_CMD_PASET, params, 4)) != 0) {
+        return result;
+    }
+    if ((result = sunxi_spi_display_command(display, SUNXI_SPI_DISPLAY_CMD_RAMWR, NULL, 0)) != 0) {
+        return result;
+    }
+
+    /* Full width windows are contiguous in the frame, others are gathered in the buffer */
+    if (width == display->width * SUNXI_SPI_DISPLAY_BPP) {
+        pixels = display->frame + y0 * width;
+        len = (y1 - y0 + 1) * width;
+    } else {
+        pixels = display->buffer;
+        for (row = y0; row <= y1; row++) {
+            offset = (row * display->width + x0) * SUNXI_SPI_DISPLAY_BPP;
+            memcpy(display->buffer + len, display->frame + offset, width);
+            len += width;
+        }
+    }
+    if ((result = sunxi_spi_display_write(display, pixels, len, 1)) != 0) {
+        return result;
+    }
+    for (row = y0; row <= y1; row++) {
+        offset = (row * display->width + x0) * SUNXI_SPI_DISPLAY_BPP;
+        memcpy(display->shadow + offset, display->frame + offset, width);
+    }
+    display->bytes += 3 + 8 + len;
+    display->windows++;
+    return 0;
+}
+
+
+/****************************************************************************************/
+/* Exported functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Initialize SPI display, the GPIO interface must be initialized and the panel configured in RGB565
+ * The first update sends the whole frame, the panel content being unknown.
+ * @param display SPI display
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param dc_pin D/C pin, see SUNXI_GPIO_PIN macros
+ * @param width Display width
+ * @param height Display height
+ * @param speed Speed of SPI interface, 32bits format (Hz), 0 to use the device setting
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_display_init(struct sunxi_spi_display *display, int fd, unsigned int dc_pin, unsigned int width, unsigned int height, __u32 speed) {
+
+    size_t size = (size_t)width * height * SUNXI_SPI_DISPLAY_BPP;
+    int result;
+
+    if ((width == 0) || (height == 0)) {
+        return EINVAL;
+    }
+    memset(display, 0, sizeof(struct sunxi_spi_display));
+    display->fd = fd;
+    display->dc_pin = dc_pin;
+    display->width = width;
+    display->height = height;
+    display->speed = speed;
+    display->full = 1;
+    if ((result = sunxi_gpio_set_cfgpin(dc_pin, SUNXI_GPIO_OUTPUT)) < 0) {
+        return -result;
+    }
+    display->frame = calloc(1, size);
+    display->shadow = calloc(1, size);
+    display->buffer = malloc(size);
+    if ((display->frame == NULL) || (display->shadow == NULL) || (display->buffer == NULL)) {
+        sunxi_spi_display_deinit(display);
+        return ENOMEM;
+    }
+    return 0;
+}
+
+/**
+ * Send command to SPI display
+ * @param display SPI display
+ * @param cmd Command
+ * @param params Command parameters, NULL if not defined
+ * @param len Length of parameters
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_display_command(struct sunxi_spi_display *display, __u8 cmd, unsigned char *params, __u32 len) {
+
+    int result;
+
+    if ((result = sunxi_spi_display_write(display, &cmd, 1, 0)) != 0) {
+        return result;
+    }
+    if ((params != NULL) && (len > 0)) {
+        return sunxi_spi_display_write(display, params, len, 1);
+    }
+    return 0;
+}
+
+/**
+ * Draw RGB888 area in the frame, converted to RGB565, sent at the next update
+ * @param display SPI display
+ * @param x Column of the area
+ * @param y Row of the area
+ * @param w Width of the area
+ * @param h Height of the area
+ * @param rgb RGB888 pixels
+ * @param stride Bytes between two rows of pixels
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_display_draw_rgb888(struct sunxi_spi_display *display, unsigned int x, unsigned int y, unsigned int w, unsigned int h, const unsigned char *rgb, unsigned int stride) {
+
+    unsigned int row;
+
+    if ((x >= display->width) || (y >= display->height) || (w > display->width - x) || (h > display->height - y)) {
+        return EINVAL;
+    }
+    for (row = 0; row < h; row++) {
+        sunxi_spi_display_convert(display->frame + ((y + row) * display->width + x) * SUNXI_SPI_DISPLAY_BPP, rgb + row * stride, w);
+    }
+    return 0;
+}
+
+/**
+ * Update SPI display, only the rows changed since the previous update are sent
+ * Consecutive changed rows are sent as a single window covering their changed columns, unless their
+ * columns are disjoint or the window would grow by more unchanged pixels than the cost of a new
+ * window (SUNXI_SPI_DISPLAY_WINDOW_COST).
+ * @param display SPI display
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_display_update(struct sunxi_spi_display *display) {
+
+    unsigned int row = 0, y0, x0, x1, first, last, left, right;
+    unsigned long area, merged;
+    int result;
+
+    while (row < display->height) {
+        if (!sunxi_spi_display_span(display, row, &x0, &x1)) {
+            row++;
+            continue;
+        }
+        y0 = row++;
+        while ((row < display->height) && sunxi_spi_display_span(display, row, &first, &last)) {
+            if ((first > x1) || (last < x0)) {
+                break;
+            }
+            left = (first < x0) ? first : x0;
+            right = (last > x1) ? last : x1;
+            area = (unsigned long)(x1 - x0 + 1) * (row - y0) + (last - first + 1);
+            merged = (unsigned long)(right - left + 1) * (row - y0 + 1);
+            if (merged > area + SUNXI_SPI_DISPLAY_WINDOW_COST) {
+                break;
+            }
+            x0 = left;
+            x1 = right;
+            row++;
+        }
+        if ((result = sunxi_spi_display_window(display, x0, y0, x1, row - 1)) != 0) {
+            return result;
+        }
+    }
+    display->full = 0;
+    return 0;
+}
+
+/**
+ * Invalidate SPI display, the whole frame is sent at the next update
+ * @param display SPI display
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_display_invalidate(struct sunxi_spi_display *display) {
+
+    display->full = 1;
+    return 0;
+}
+
+/**
+ * Deinitialize SPI display
+ * @param display SPI display
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_display_deinit(struct sunxi_spi_display *display) {
+
+    free(display->frame);
+    free(display->shadow);
+    free(display->buffer);
+    display->frame = NULL;
+    display->shadow = NULL;
+    display->buffer = NULL;
+    return 0;
+}
@@ -0,0 +1,66 @@
+/****************************************************************************************/
+/* SUNXI SPI display library interface                                                  */
+/****************************************************************************************/
+
+#ifndef SUNXI_SPI_DISPLAY_H_
+#define SUNXI_SPI_DISPLAY_H_
+
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include "spi.h"
+#include "gpio.h"
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* SUNXI SPI display commands (MIPI DCS, ILI9341/ST7789 class panels) */
+#define SUNXI_SPI_DISPLAY_CMD_CASET             0x2A
+#define SUNXI_SPI_DISPLAY_CMD_PASET             0x2B
+#define SUNXI_SPI_DISPLAY_CMD_RAMWR             0x2C
+
+/* SUNXI SPI display bytes per pixel, RGB565 big endian */
+#define SUNXI_SPI_DISPLAY_BPP                   2
+
+/* SUNXI SPI display cost of a window (pixels), window commands and D/C switches, a changed row is
+   merged in the window above if it adds fewer unchanged pixels */
+#define SUNXI_SPI_DISPLAY_WINDOW_COST           32
+
+
+/****************************************************************************************/
+/* Types                                                                                */
+/****************************************************************************************/
+
+/* SUNXI SPI display, frame drawn by the application and shadow of the panel content (RGB565) */
+struct sunxi_spi_display {
+    int fd;
+    unsigned int dc_pin;
+    unsigned int width;
+    unsigned int height;
+    __u32 speed;
+    unsigned char *frame;
+    unsigned char *shadow;
+    unsigned char *buffer;
+    int full;
+    unsigned long long bytes;
+    unsigned long long windows;
+};
+
+
+/****************************************************************************************/
+/* Prototypes                                                                           */
+/****************************************************************************************/
+
+int sunxi_spi_display_init(struct sunxi_spi_display *display, int fd, unsigned int dc_pin, unsigned int width, unsigned int height, __u32 speed);
+int sunxi_spi_display_command(struct sunxi_spi_display *display, __u8 cmd, unsigned char *params, __u32 len);
+int sunxi_spi_display_draw_rgb888(struct sunxi_spi_display *display, unsigned int x, unsigned int y, unsigned int w, unsigned int h, const unsigned char *rgb, unsigned int stride);
+int sunxi_spi_display_update(struct sunxi_spi_display *display);
+int sunxi_spi_display_invalidate(struct sunxi_spi_display *display);
+int sunxi_spi_display_deinit(struct sunxi_spi_display *display);
+
+
+#endif
@@ -0,0 +1,465 @@
+/****************************************************************************************/
+/* SUNXI SPI NOR flash library interface                                                */
+/****************************************************************************************/
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include "spi_flash.h"
+
+
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Build SPI flash command header, command followed by a 3 bytes address
+ * @param header Header buffer, 4 bytes
+ * @param cmd Command
+ * @param addr Address
+ */
+static void sunxi_spi_flash_header(unsigned char *header, __u8 cmd, __u32 addr) {
+
+    header[0] = cmd;
+    header[1] = (addr >> 16) & 0xFF;
+    header[2] = (addr >> 8) & 0xFF;
+    header[3] = addr & 0xFF;
+}
+
+/**
+ * Execute SPI flash program or erase command and wait for its completion
+ * The write enable, a status read checking that the write enable latch is set (not set if the status
+ * register is protected), the command and the first status polls are sent in a single message, the
+ * status being then polled by messages of SUNXI_SPI_FLASH_POLLS reads until the operation completes,
+ * the latch being reset by the flash once the command has been executed. The command is sent without
+ * delay because the flash starts the operation when chip select is deasserted, the poll period being
+ * carried by the status reads only.
+ * @param flash SPI flash
+ * @param header Command and address
+ * @param header_len Length of command and address
+ * @param data Data to be programmed, NULL if not defined
+ * @param data_len Length of data to be programmed
+ * @param timeout_ms Operation timeout (ms)
+ * @return 0 if the function succeeds, EROFS if the flash is write protected, error code otherwise
+ */
+static int sunxi_spi_flash_execute(struct sunxi_spi_flash *flash, unsigned char *header, __u32 header_len, unsigned char *data, __u32 data_len, unsigned int timeout_ms) {
+
+    struct spi_ioc_transfer transfers[4 + SUNXI_SPI_FLASH_POLLS];
+    struct sunxi_spi_message message;
+    unsigned char wren = SUNXI_SPI_FLASH_CMD_WREN;
+    unsigned char rdsr[2] = { SUNXI_SPI_FLASH_CMD_RDSR, 0 };
+    unsigned char wel[2];
+    unsigned char status[SUNXI_SPI_FLASH_POLLS][2];
+    struct timespec start, now;
+    unsigned int index, elapsed_ms;
+    __u16 delay;
+    int result, first = 1;
+
+    /* Poll period, a hundredth of the timeout between two status reads */
+    delay = (timeout_ms * 10 < 65535) ? timeout_ms * 10 : 65535;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        sunxi_spi_message_init(&message, transfers, 4 + SUNXI_SPI_FLASH_POLLS);
+        if (first) {
+            sunxi_spi_message_add(&message, &wren, NULL, 1, flash->speed, 0, 0, 1);
+            sunxi_spi_message_add(&message, rdsr, wel, 2, flash->speed, 0, 0, 1);
+            if (data != NULL) {
+                sunxi_spi_message_add(&message, header, NULL, header_len, flash->speed, 0, 0, 0);
+                sunxi_spi_message_add(&message, data, NULL, data_len, flash->speed, 0, 0, 1);
+            } else {
+                sunxi_spi_message_add(&message, header, NULL, header_len, flash->speed, 0, 0, 1);
+            }
+        }
+        for (index = 0; index < SUNXI_SPI_FLASH_POLLS; index++) {
+            status[index][1] = SUNXI_SPI_FLASH_SR_WIP;
+            sunxi_spi_message_add(&message, rdsr, status[index], 2, flash->speed, 0,
+                                  (index < SUNXI_SPI_FLASH_POLLS - 1) ? delay : 0,
+                                  (index < SUNXI_SPI_FLASH_POLLS - 1) ? 1 : 0);
+        }
+        if ((result = sunxi_spi_message_submit(flash->fd, &message)) != 0) {
+            return result;
+        }
+        /* Write enable ignored, the command has not been executed */
+        if (first && !(wel[1] & SUNXI_SPI_FLASH_SR_WEL)) {
+            return EROFS;
+        }
+        for (index = 0; index < SUNXI_SPI_FLASH_POLLS; index++) {
+            /* Write enable latch reset at the end of the operation, still set if the command was
+               ignored (protected area) */
+            if (!(status[index][1] & SUNXI_SPI_FLASH_SR_WIP)) {
+                return (status[index][1] & SUNXI_SPI_FLASH_SR_WEL) ? EROFS : 0;
+            }
+        }
+        first = 0;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    } while (elapsed_ms < timeout_ms);
+
+    return ETIMEDOUT;
+}
+
+/**
+ * Read SPI flash register
+ * @param flash SPI flash
+ * @param cmd Read register command (SUNXI_SPI_FLASH_CMD_RDSR or SUNXI_SPI_FLASH_CMD_RDSR2)
+ * @param value Register value
+ * @return 0 if the function succeeds, error code otherwise
+ */
+static int sunxi_spi_flash_read_register(struct sunxi_spi_flash *flash, __u8 cmd, __u8 *value) {
+
+    unsigned char tx[2] = { cmd, 0 };
+    unsigned char rx[2];
+    struct sunxi_spi_segment segment;
+    int result;
+
+    memset(&segment, 0, sizeof(struct sunxi_spi_segment));
+    segment.tx = tx;
+    segment.rx = rx;
+    segment.len = 2;
+    segment.speed = flash->speed;
+    if ((result = sunxi_spi_transfer_segments(flash->fd, &segment, 1)) != 0) {
+        return result;
+    }
+    *value = rx[1];
+    return 0;
+}
+
+/**
+ * Read SPI flash quad enable bit, its location depending on the manufacturer
+ * @param flash SPI flash, probed
+ * @param enabled 1 if the quad enable bit is set, 0 otherwise
+ * @return 0 if the function succeeds, EOPNOTSUPP if the manufacturer is unknown, error code otherwise
+ */
+static int sunxi_spi_flash_read_quad(struct sunxi_spi_flash *flash, int *enabled) {
+
+    __u8 status;
+    int result;
+
+    switch (flash->id[0]) {
+        case SUNXI_SPI_FLASH_MFR_WINBOND:
+        case SUNXI_SPI_FLASH_MFR_GIGADEVICE:
+            /* Quad enable in status register 2 */
+            if ((result = sunxi_spi_flash_read_register(flash, SUNXI_SPI_FLASH_CMD_RDSR2, &status)) != 0) {
+                return result;
+            }
+            *enabled = (status & SUNXI_SPI_FLASH_SR2_QE) ? 1 : 0;
+            return 0;
+        case SUNXI_SPI_FLASH_MFR_MACRONIX:
+            /* Quad enable in status register */
+            if ((result = sunxi_spi_flash_read_register(flash, SUNXI_SPI_FLASH_CMD_RDSR, &status)) != 0) {
+                return result;
+            }
+            *enabled = (status & SUNXI_SPI_FLASH_SR_QE_MXIC) ? 1 : 0;
+            return 0;
+        default:
+            return EOPNOTSUPP;
+    }
+}
+
+/**
+ * Select the fastest read command supported by the device and the flash, quad read requiring the
+ * quad enable bit
+ * @param flash SPI flash, probed
+ */
+static void sunxi_spi_flash_select_read(struct sunxi_spi_flash *flash) {
+
+    __u32 mode, check;
+    int quad = 0;
+
+    flash->read_cmd = SUNXI_SPI_FLASH_CMD_FAST_READ;
+    flash->read_nbits = 1;
+    if (sunxi_spi_read_mode32(flash->fd, &mode) != 0) {
+        return;
+    }
+    mode &= ~(SPI_RX_DUAL | SPI_RX_QUAD);
+    if ((sunxi_spi_flash_read_quad(flash, &quad) == 0) && quad &&
+        (sunxi_spi_write_mode32(flash->fd, mode | SPI_RX_QUAD) == 0) &&
+        (sunxi_spi_read_mode32(flash->fd, &check) == 0) && (check & SPI_RX_QUAD)) {
+        flash->read_cmd = SUNXI_SPI_FLASH_CMD_QUAD_READ;
+        flash->read_nbits = 4;
+    } else if ((sunxi_spi_write_mode32(flash->fd, mode | SPI_RX_DUAL) == 0) &&
+               (sunxi_spi_read_mode32(flash->fd, &check) == 0) && (check & SPI_RX_DUAL)) {
+        flash->read_cmd = SUNXI_SPI_FLASH_CMD_DUAL_READ;
+        flash->read_nbits = 2;
+    } else {
+        sunxi_spi_write_mode32(flash->fd, mode);
+    }
+}
+
+/****************************************************************************************/
+/* Exported functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Open SPI flash, probe its JEDEC ID and select the fastest read command supported by the device
+ * Quad read is used if SPI_RX_QUAD is accepted by sunxi_spi_write_mode32 and the quad enable bit of
+ * the flash is already set (see sunxi_spi_flash_enable_quad), dual read is used otherwise if
+ * SPI_RX_DUAL is accepted. The flash status registers are not written.
+ * @param flash SPI flash
+ * @param fd File descriptor get from sunxi_spi_open
+ * @param speed Speed of SPI interface, 32bits format (Hz), 0 to use the device setting
+ * @return 0 if the function succeeds, ENODEV if no flash answers, error code otherwise
+ */
+int sunxi_spi_flash_open(struct sunxi_spi_flash *flash, int fd, __u32 speed) {
+
+    int result;
+
+    memset(flash, 0, sizeof(struct sunxi_spi_flash));
+    flash->fd = fd;
+    flash->speed = speed;
+
+    /* Probe flash */
+    if ((result = sunxi_spi_flash_read_id(flash, flash->id)) != 0) {
+        return result;
+    }
+    if (((flash->id[0] == 0x00) && (flash->id[1] == 0x00) && (flash->id[2] == 0x00)) ||
+        ((flash->id[0] == 0xFF) && (flash->id[1] == 0xFF) && (flash->id[2] == 0xFF))) {
+        return ENODEV;
+    }
+    /* Capacity byte is log2 of the size for most vendors, 3 bytes addressing up to 16MB */
+    if ((flash->id[2] >= 0x10) && (flash->id[2] <= 0x18)) {
+        flash->size = 1 << flash->id[2];
+    }
+
+    /* Select read command */
+    sunxi_spi_flash_select_read(flash);
+    return 0;
+}
+
+/**
+ * Set SPI flash quad enable bit and select quad read if the device supports it
+ * The bit is non-volatile, IO2 and IO3 being then used as data lanes instead of WP# and HOLD#: to be
+ * called only on boards wiring the four data lanes. The status registers are written only if the bit
+ * is not already set (Winbond and GigaDevice status register 2, Macronix status register).
+ * @param flash SPI flash
+ * @return 0 if the function succeeds, EOPNOTSUPP if the manufacturer is unknown, error code otherwise
+ */
+int sunxi_spi_flash_enable_quad(struct sunxi_spi_flash *flash) {
+
+    unsigned char header[3];
+    __u8 status, status2;
+    int result, enabled;
+
+    if ((result = sunxi_spi_flash_read_quad(flash, &enabled)) != 0) {
+        return result;
+    }
+    if (!enabled) {
+        if ((result = sunxi_spi_flash_read_status(flash, &status)) != 0) {
+            return result;
+        }
+        header[0] = SUNXI_SPI_FLASH_CMD_WRSR;
+        if (flash->id[0] == SUNXI_SPI_FLASH_MFR_MACRONIX) {
+            header[1] = status | SUNXI_SPI_FLASH_SR_QE_MXIC;
+            result = sunxi_spi_flash_execute(flash, header, 2, NULL, 0, SUNXI_SPI_FLASH_TIMEOUT_STATUS);
+        } else {
+            /* Both registers written by a 2 bytes write status, status register 1 unchanged */
+            if ((result = sunxi_spi_flash_read_register(flash, SUNXI_SPI_FLASH_CMD_RDSR2, &status2)) != 0) {
+                return result;
+            }
+            header[1] = status;
+            header[2] = status2 | SUNXI_SPI_FLASH_SR2_QE;
+            result = sunxi_spi_flash_execute(flash, header, 3, NULL, 0, SUNXI_SPI_FLASH_TIMEOUT_STATUS);
+        }
+        if (result != 0) {
+            return result;
+        }
+        if ((result = sunxi_spi_flash_read_quad(flash, &enabled)) != 0) {
+            return result;
+        }
+        if (!enabled) {
+            return EIO;
+        }
+    }
+
+    /* Select read command */
+    sunxi_spi_flash_select_read(flash);
+    return 0;
+}
+
+/**
+ * Read SPI flash JEDEC ID
+ * @param flash SPI flash
+ * @param id Manufacturer ID, memory type and capacity
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_flash_read_id(struct sunxi_spi_flash *flash, __u8 id[3]) {
+
+    unsigned char tx[4] = { SUNXI_SPI_FLASH_CMD_RDID, 0, 0, 0 };
+    unsigned char rx[4];
+    struct sunxi_spi_segment segment;
+    int result;
+
+    memset(&segment, 0, sizeof(struct sunxi_spi_segment));
+    segment.tx = tx;
+    segment.rx = rx;
+    segment.len = 4;
+    segment.speed = flash->speed;
+    if ((result = sunxi_spi_transfer_segments(flash->fd, &segment, 1)) != 0) {
+        return result;
+    }
+    memcpy(id, rx + 1, 3);
+    return 0;
+}
+
+/**
+ * Read SPI flash status register
+ * @param flash SPI flash
+ * @param status Status register (SUNXI_SPI_FLASH_SR_XXX)
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_flash_read_status(struct sunxi_spi_flash *flash, __u8 *status) {
+
+    return sunxi_spi_flash_read_register(flash, SUNXI_SPI_FLASH_CMD_RDSR, status);
+}
+
+/**
+ * Read SPI flash, with fast, dual or quad read, as much data as the spidev buffer allows per message
+ * @param flash SPI flash
+ * @param addr Address
+ * @param data Data read
+ * @param len Length of data to be read
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_flash_read(struct sunxi_spi_flash *flash, __u32 addr, unsigned char *data, __u32 len) {
+
+    struct spi_ioc_transfer transfers[2];
+    struct sunxi_spi_message message;
+    unsigned char header[5];
+    __u32 bufsiz, chunk;
+    int result;
+
+    if ((flash->size != 0) && ((addr >= flash->size) || (len > flash->size - addr))) {
+        return EINVAL;
+    }
+    sunxi_spi_get_bufsiz(&bufsiz);
+    sunxi_spi_message_init(&message, transfers, 2);
+    while (len > 0) {
+        chunk = (len < bufsiz - sizeof(header)) ? len : bufsiz - sizeof(header);
+
+        /* Command, address and dummy byte, then data on the read lanes */
+        sunxi_spi_flash_header(header, flash->read_cmd, addr);
+        header[4] = 0;
+        sunxi_spi_message_reset(&message);
+        sunxi_spi_message_add(&message, header, NULL, sizeof(header), flash->speed, 0, 0, 0);
+        sunxi_spi_message_add(&message, NULL, data, chunk, flash->speed, 0, 0, 0);
+        transfers[1].rx_nbits = flash->read_nbits;
+        if ((result = sunxi_spi_message_submit(flash->fd, &message)) != 0) {
+            return result;
+        }
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/**
+ * Write SPI flash, page by page, the area must have been erased
+ * Each page is programmed by a single message (write enable, page program and status polls).
+ * @param flash SPI flash
+ * @param addr Address
+ * @param data Data to be written
+ * @param len Length of data to be written
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_flash_write(struct sunxi_spi_flash *flash, __u32 addr, unsigned char *data, __u32 len) {
+
+    unsigned char header[4];
+    __u32 chunk;
+    int result;
+
+    if ((flash->size != 0) && ((addr >= flash->size) || (len > flash->size - addr))) {
+        return EINVAL;
+    }
+    while (len > 0) {
+        chunk = SUNXI_SPI_FLASH_PAGE_SIZE - (addr % SUNXI_SPI_FLASH_PAGE_SIZE);
+        if (chunk > len) {
+            chunk = len;
+        }
+        sunxi_spi_flash_header(header, SUNXI_SPI_FLASH_CMD_PP, addr);
+        if ((result = sunxi_spi_flash_execute(flash, header, sizeof(header), data, chunk, SUNXI_SPI_FLASH_TIMEOUT_PROGRAM)) != 0) {
+            return result;
+        }
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/**
+ * Erase SPI flash sector (4KB)
+ * @param flash SPI flash
+ * @param addr Address of the sector
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_flash_erase_sector(struct sunxi_spi_flash *flash, __u32 addr) {
+
+    unsigned char header[4];
+
+    sunxi_spi_flash_header(header, SUNXI_SPI_FLASH_CMD_SE, addr);
+    return sunxi_spi_flash_execute(flash, header, sizeof(header), NULL, 0, SUNXI_SPI_FLASH_TIMEOUT_SECTOR);
+}
+
+/**
+ * Erase SPI flash block (64KB)
+ * @param flash SPI flash
+ * @param addr Address of the block
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_flash_erase_block(struct sunxi_spi_flash *flash, __u32 addr) {
+
+    unsigned char header[4];
+
+    sunxi_spi_flash_header(header, SUNXI_SPI_FLASH_CMD_BE, addr);
+    return sunxi_spi_flash_execute(flash, header, sizeof(header), NULL, 0, SUNXI_SPI_FLASH_TIMEOUT_BLOCK);
+}
+
+/**
+ * Erase whole SPI flash
+ * @param flash SPI flash
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_flash_erase_chip(struct sunxi_spi_flash *flash) {
+
+    unsigned char header = SUNXI_SPI_FLASH_CMD_CE;
+
+    return sunxi_spi_flash_execute(flash, &header, 1, NULL, 0, SUNXI_SPI_FLASH_TIMEOUT_CHIP);
+}
+
+/**
+ * Erase SPI flash area, with block erases where aligned and sector erases otherwise
+ * @param flash SPI flash
+ * @param addr Address of the area, aligned on a sector
+ * @param len Length of the area, multiple of the sector size
+ * @return 0 if the function succeeds, error code otherwise
+ */
+int sunxi_spi_flash_erase(struct sunxi_spi_flash *flash, __u32 addr, __u32 len) {
+
+    int result;
+
+    if ((addr % SUNXI_SPI_FLASH_SECTOR_SIZE) || (len % SUNXI_SPI_FLASH_SECTOR_SIZE)) {
+        return EINVAL;
+    }
+    if ((flash->size != 0) && ((addr >= flash->size) || (len > flash->size - addr))) {
+        return EINVAL;
+    }
+    while (len > 0) {
+        if (((addr % SUNXI_SPI_FLASH_BLOCK_SIZE) == 0) && (len >= SUNXI_SPI_FLASH_BLOCK_SIZE)) {
+            if ((result = sunxi_spi_flash_erase_block(flash, addr)) != 0) {
+                return result;
+            }
+            addr += SUNXI_SPI_FLASH_BLOCK_SIZE;
+            len -= SUNXI_SPI_FLASH_BLOCK_SIZE;
+        } else {
+            if ((result = sunxi_spi_flash_erase_sector(flash, addr)) != 0) {
+                return result;
+            }
+            addr += SUNXI_SPI_FLASH_SECTOR_SIZE;
+            len -= SUNXI_SPI_FLASH_SECTOR_SIZE;
+        }
+    }
+    return 0;
+}
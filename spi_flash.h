@@ -0,0 +1,95 @@
+/****************************************************************************************/
+/* SUNXI SPI NOR flash library interface                                                */
+/****************************************************************************************/
+
+#ifndef SUNXI_SPI_FLASH_H_
+#define SUNXI_SPI_FLASH_H_
+
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include "spi.h"
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* SUNXI SPI flash commands (JEDEC) */
+#define SUNXI_SPI_FLASH_CMD_WREN                0x06
+#define SUNXI_SPI_FLASH_CMD_RDSR                0x05
+#define SUNXI_SPI_FLASH_CMD_RDSR2               0x35
+#define SUNXI_SPI_FLASH_CMD_WRSR                0x01
+#define SUNXI_SPI_FLASH_CMD_READ                0x03
+#define SUNXI_SPI_FLASH_CMD_FAST_READ           0x0B
+#define SUNXI_SPI_FLASH_CMD_DUAL_READ           0x3B
+#define SUNXI_SPI_FLASH_CMD_QUAD_READ           0x6B
+#define SUNXI_SPI_FLASH_CMD_PP                  0x02
+#define SUNXI_SPI_FLASH_CMD_SE                  0x20
+#define SUNXI_SPI_FLASH_CMD_BE                  0xD8
+#define SUNXI_SPI_FLASH_CMD_CE                  0xC7
+#define SUNXI_SPI_FLASH_CMD_RDID                0x9F
+
+/* SUNXI SPI flash status register bits */
+#define SUNXI_SPI_FLASH_SR_WIP                  (1 << 0)
+#define SUNXI_SPI_FLASH_SR_WEL                  (1 << 1)
+
+/* SUNXI SPI flash quad enable bits, status register 2 (Winbond, GigaDevice) or status register (Macronix) */
+#define SUNXI_SPI_FLASH_SR2_QE                  (1 << 1)
+#define SUNXI_SPI_FLASH_SR_QE_MXIC              (1 << 6)
+
+/* SUNXI SPI flash manufacturer IDs (JEDEC) */
+#define SUNXI_SPI_FLASH_MFR_WINBOND             0xEF
+#define SUNXI_SPI_FLASH_MFR_GIGADEVICE          0xC8
+#define SUNXI_SPI_FLASH_MFR_MACRONIX            0xC2
+
+/* SUNXI SPI flash geometry */
+#define SUNXI_SPI_FLASH_PAGE_SIZE               256
+#define SUNXI_SPI_FLASH_SECTOR_SIZE             4096
+#define SUNXI_SPI_FLASH_BLOCK_SIZE              65536
+
+/* SUNXI SPI flash status polls appended to a program or erase message */
+#define SUNXI_SPI_FLASH_POLLS                   8
+
+/* SUNXI SPI flash operation timeouts (ms) */
+#define SUNXI_SPI_FLASH_TIMEOUT_PROGRAM         10
+#define SUNXI_SPI_FLASH_TIMEOUT_STATUS          20
+#define SUNXI_SPI_FLASH_TIMEOUT_SECTOR          1000
+#define SUNXI_SPI_FLASH_TIMEOUT_BLOCK           4000
+#define SUNXI_SPI_FLASH_TIMEOUT_CHIP            400000
+
+
+/****************************************************************************************/
+/* Types                                                                                */
+/****************************************************************************************/
+
+/* SUNXI SPI flash, 3 bytes addressing */
+struct sunxi_spi_flash {
+    int fd;
+    __u8 id[3];
+    __u32 size;
+    __u8 read_cmd;
+    __u8 read_nbits;
+    __u32 speed;
+};
+
+
+/****************************************************************************************/
+/* Prototypes                                                                           */
+/****************************************************************************************/
+
+int sunxi_spi_flash_open(struct sunxi_spi_flash *flash, int fd, __u32 speed);
+int sunxi_spi_flash_enable_quad(struct sunxi_spi_flash *flash);
+int sunxi_spi_flash_read_id(struct sunxi_spi_flash *flash, __u8 id[3]);
+int sunxi_spi_flash_read_status(struct sunxi_spi_flash *flash, __u8 *status);
+int sunxi_spi_flash_read(struct sunxi_spi_flash *flash, __u32 addr, unsigned char *data, __u32 len);
+int sunxi_spi_flash_write(struct sunxi_spi_flash *flash, __u32 addr, unsigned char *data, __u32 len);
+int sunxi_spi_flash_erase_sector(struct sunxi_spi_flash *flash, __u32 addr);
+int sunxi_spi_flash_erase_block(struct sunxi_spi_flash *flash, __u32 addr);
+int sunxi_spi_flash_erase_chip(struct sunxi_spi_flash *flash);
+int sunxi_spi_flash_erase(struct sunxi_spi_flash *flash, __u32 addr, __u32 len);
+
+
+#endif
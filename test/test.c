@@ -0,0 +1,593 @@
+/****************************************************************************************/
+/* SUNXI library checks, run against the simulator                                      */
+/****************************************************************************************/
+
+/****************************************************************************************/
+/* Includes                                                                             */
+/****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "hw.h"
+#include "gpio.h"
+#include "lock.h"
+#include "lradc.h"
+#include "pwm.h"
+#include "spi_flash.h"
+#include "spi_display.h"
+#include "sim.h"
+
+
+/****************************************************************************************/
+/* Definitions                                                                          */
+/****************************************************************************************/
+
+/* Number of threads or processes and toggles per thread of the lock stress checks */
+#define SUNXI_TEST_WORKERS                      8
+#define SUNXI_TEST_TOGGLES                      2000000
+
+/* First pin of the lock stress checks, one pin per worker in the same bank */
+#define SUNXI_TEST_PIN                          SUNXI_GPIO_PIN_PA0
+
+/* External interrupt pins of the GPIO events check, positive edge and double edge triggers */
+#define SUNXI_TEST_EINT_RISING_PIN              SUNXI_GPIO_PIN('H', 0)
+#define SUNXI_TEST_EINT_BOTH_PIN                SUNXI_GPIO_PIN('H', 1)
+
+/* GPIO events check pulses, and input level hold time (us) longer than the simulator period */
+#define SUNXI_TEST_EINT_PULSES                  3
+#define SUNXI_TEST_EINT_HOLD                    10000
+
+/* Area of the SPI flash check, written across pages and sectors */
+#define SUNXI_TEST_FLASH_ADDR                   0x10000
+#define SUNXI_TEST_FLASH_ERASE                  0x3000
+#define SUNXI_TEST_FLASH_OFFSET                 0x123
+#define SUNXI_TEST_FLASH_LEN                    0x2345
+
+/* Panel of the SPI display check, on the loopback simulator */
+#define SUNXI_TEST_DISPLAY_WIDTH                320
+#define SUNXI_TEST_DISPLAY_HEIGHT               240
+#define SUNXI_TEST_DISPLAY_DC_PIN               SUNXI_GPIO_PIN_PB2
+
+/* Bytes of a SPI display window, window commands and parameters followed by the pixels */
+#define SUNXI_TEST_DISPLAY_WINDOW(w, h)         (3 + 8 + (w) * (h) * SUNXI_SPI_DISPLAY_BPP)
+
+/* LRADC values of the checks, pressed key and released (above the key level) */
+#define SUNXI_TEST_LRADC_KEY                    0x10
+#define SUNXI_TEST_LRADC_RELEASED               0x3F
+
+/* LRADC monitor polling period (us), shorter than the 4ms sample period at 250Hz */
+#define SUNXI_TEST_LRADC_PERIOD                 500
+
+/* Samples read by the consumers keeping up, the lagging one falling behind the ring */
+#define SUNXI_TEST_LRADC_SAMPLES                (SUNXI_LRADC_RING_SIZE + 16)
+
+/* SUNXI PWM compile check, expected configuration of a period */
+struct sunxi_test_pwm_period {
+  __u64 period_ns;
+  unsigned int prescaler;
+  unsigned int cycles;
+  __s64 error_ns;
+};
+
+/* SUNXI lock stress worker */
+struct sunxi_test_worker {
+  pthread_t thread;
+  pthread_barrier_t *barrier;
+  unsigned int pin;
+  unsigned int lost;
+};
+
+
+/****************************************************************************************/
+/* Internal functions                                                                   */
+/****************************************************************************************/
+
+/**
+ * Toggle a pin and count the lost updates, the written value not being read back
+ * @param pin Pin of the worker
+ * @return Number of lost updates
+ */
+static unsigned int sunxi_test_toggle(unsigned int pin) {
+
+  unsigned int index, lost = 0;
+
+  for (index = 0; index < SUNXI_TEST_TOGGLES; index++) {
+    sunxi_gpio_output(pin, 1);
+    if (sunxi_gpio_input(pin) != 1) lost++;
+    sunxi_gpio_output(pin, 0);
+    if (sunxi_gpio_input(pin) != 0) lost++;
+  }
+
+  return lost;
+}
+
+/**
+ * Lock stress thread
+ * @param arg Worker
+ * @return Always NULL
+ */
+static void *sunxi_test_thread(void *arg) {
+
+  struct sunxi_test_worker *worker = (struct sunxi_test_worker *)arg;
+
+  pthread_barrier_wait(worker->barrier);
+  worker->lost = sunxi_test_toggle(worker->pin);
+  return NULL;
+}
+
+/**
+ * Check that threads toggling pins of the same bank lose no update with SUNXI_LOCK_MODE_THREAD
+ * @return Number of lost updates
+ */
+static unsigned int sunxi_test_lock_thread() {
+
+  struct sunxi_test_worker workers[SUNXI_TEST_WORKERS];
+  pthread_barrier_t barrier;
+  unsigned int index, lost = 0;
+
+  sunxi_lock_set_mode(SUNXI_LOCK_MODE_THREAD);
+  pthread_barrier_init(&barrier, NULL, SUNXI_TEST_WORKERS);
+  for (index = 0; index < SUNXI_TEST_WORKERS; index++) {
+    workers[index].barrier = &barrier;
+    workers[index].pin = SUNXI_TEST_PIN + index;
+    workers[index].lost = 0;
+    sunxi_gpio_set_cfgpin(workers[index].pin, SUNXI_GPIO_OUTPUT);
+    pthread_create(&workers[index].thread, NULL, sunxi_test_thread, &workers[index]);
+  }
+  for (index = 0; index < SUNXI_TEST_WORKERS; index++) {
+    pthread_join(workers[index].thread, NULL);
+    lost += workers[index].lost;
+  }
+  pthread_barrier_destroy(&barrier);
+  sunxi_lock_set_mode(SUNXI_LOCK_MODE_NONE);
+
+  return lost;
+}
+
+/**
+ * Check that processes toggling pins of the same bank lose no update with SUNXI_LOCK_MODE_PROCESS
+ * The processes share the simulated registers and the locks through the inherited mappings. The
+ * mode must be refused while the process-private shadow registers are enabled.
+ * @return Number of processes which lost updates, plus one if the mode is wrongly accepted
+ */
+static unsigned int sunxi_test_lock_process() {
+
+  pid_t pids[SUNXI_TEST_WORKERS];
+  unsigned int index, failed = 0;
+  int status;
+
+  sunxi_gpio_shadow_enable();
+  if (sunxi_lock_set_mode(SUNXI_LOCK_MODE_PROCESS) != -EBUSY) {
+    failed++;
+  }
+  sunxi_gpio_shadow_disable();
+  sunxi_lock_set_mode(SUNXI_LOCK_MODE_PROCESS);
+  for (index = 0; index < SUNXI_TEST_WORKERS; index++) {
+    sunxi_gpio_set_cfgpin(SUNXI_TEST_PIN + index, SUNXI_GPIO_OUTPUT);
+  }
+  for (index = 0; index < SUNXI_TEST_WORKERS; index++) {
+    pids[index] = fork();
+    if (pids[index] == 0) {
+      _exit(sunxi_test_toggle(SUNXI_TEST_PIN + index) ? 1 : 0);
+    }
+    if (pids[index] < 0) {
+      failed++;
+    }
+  }
+  for (index = 0; index < SUNXI_TEST_WORKERS; index++) {
+    if ((pids[index] > 0) && ((waitpid(pids[index], &status, 0) < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))) {
+      failed++;
+    }
+  }
+  sunxi_lock_set_mode(SUNXI_LOCK_MODE_NONE);
+
+  return failed;
+}
+
+/**
+ * Check GPIO external interrupt events, pulses on a positive edge pin and a double edge pin giving
+ * one event per rising edge and one event per edge respectively
+ * @return Number of errors
+ */
+static unsigned int sunxi_test_gpio_events() {
+
+  struct sunxi_gpio_event event;
+  unsigned int index, rising = 0, both = 0, errors = 0;
+
+  sunxi_sim_gpio_set_input(SUNXI_TEST_EINT_RISING_PIN, 0);
+  sunxi_sim_gpio_set_input(SUNXI_TEST_EINT_BOTH_PIN, 0);
+  usleep(SUNXI_TEST_EINT_HOLD);
+  if ((sunxi_gpio_int_set_trigger(SUNXI_TEST_EINT_RISING_PIN, SUNXI_GPIO_INT_POSITIVE_EDGE) != 0) ||
+      (sunxi_gpio_int_set_trigger(SUNXI_TEST_EINT_BOTH_PIN, SUNXI_GPIO_INT_DOUBLE_EDGE) != 0) ||
+      (sunxi_gpio_int_enable(SUNXI_TEST_EINT_RISING_PIN) != 0) || (sunxi_gpio_int_enable(SUNXI_TEST_EINT_BOTH_PIN) != 0)) {
+    errors++;
+    goto disable;
+  }
+  if (sunxi_gpio_event_open(NULL, SUNXI_TEST_EINT_HOLD / 20) < 0) {
+    errors++;
+    goto disable;
+  }
+
+  /* Pulses on both pins */
+  for (index = 0; index < SUNXI_TEST_EINT_PULSES; index++) {
+    sunxi_sim_gpio_set_input(SUNXI_TEST_EINT_RISING_PIN, 1);
+    sunxi_sim_gpio_set_input(SUNXI_TEST_EINT_BOTH_PIN, 1);
+    usleep(SUNXI_TEST_EINT_HOLD);
+    sunxi_sim_gpio_set_input(SUNXI_TEST_EINT_RISING_PIN, 0);
+    sunxi_sim_gpio_set_input(SUNXI_TEST_EINT_BOTH_PIN, 0);
+    usleep(SUNXI_TEST_EINT_HOLD);
+  }
+
+  /* Exactly one event per rising edge and one event per edge */
+  while (sunxi_gpio_event_wait(&event, SUNXI_TEST_EINT_HOLD / 1000 * 2) == 0) {
+    if (event.lost != 0) errors++;
+    if (event.pin == SUNXI_TEST_EINT_RISING_PIN) rising++;
+    else if (event.pin == SUNXI_TEST_EINT_BOTH_PIN) both++;
+    else errors++;
+  }
+  if ((rising != SUNXI_TEST_EINT_PULSES) || (both != 2 * SUNXI_TEST_EINT_PULSES)) errors++;
+  sunxi_gpio_event_close();
+
+disable:
+  sunxi_gpio_int_disable(SUNXI_TEST_EINT_RISING_PIN);
+  sunxi_gpio_int_disable(SUNXI_TEST_EINT_BOTH_PIN);
+  sunxi_gpio_set_cfgpin(SUNXI_TEST_EINT_RISING_PIN, SUNXI_GPIO_INPUT);
+  sunxi_gpio_set_cfgpin(SUNXI_TEST_EINT_BOTH_PIN, SUNXI_GPIO_INPUT);
+
+  return errors;
+}
+
+/**
+ * Check SPI flash erase, write and read-back on the simulated flash, quad read being selected only
+ * once quad mode is enabled, and writes being reported as failed on a protected flash
+ * @return Number of errors
+ */
+static unsigned int sunxi_test_spi_flash() {
+
+  static unsigned char data[SUNXI_TEST_FLASH_ERASE], check[SUNXI_TEST_FLASH_ERASE];
+  struct sunxi_spi_flash flash;
+  unsigned int index, errors = 0;
+
+  for (index = 0; index < SUNXI_TEST_FLASH_LEN; index++) {
+    data[index] = (index * 31 + 7) & 0xFF;
+  }
+  sunxi_spi_set_ioctl(sunxi_sim_spi_flash_ioctl);
+  if (sunxi_spi_flash_open(&flash, 0, 0) != 0) {
+    errors++;
+  } else {
+    /* Quad enable bit not written by open */
+    if (flash.read_cmd != SUNXI_SPI_FLASH_CMD_DUAL_READ) errors++;
+    if ((sunxi_spi_flash_enable_quad(&flash) != 0) || (flash.read_cmd != SUNXI_SPI_FLASH_CMD_QUAD_READ)) errors++;
+
+    /* Erase, write and read-back */
+    if (sunxi_spi_flash_erase(&flash, SUNXI_TEST_FLASH_ADDR, SUNXI_TEST_FLASH_ERASE) != 0) errors++;
+    if (sunxi_spi_flash_write(&flash, SUNXI_TEST_FLASH_ADDR + SUNXI_TEST_FLASH_OFFSET, data, SUNXI_TEST_FLASH_LEN) != 0) errors++;
+    if (sunxi_spi_flash_read(&flash, SUNXI_TEST_FLASH_ADDR, check, SUNXI_TEST_FLASH_ERASE) != 0) errors++;
+    for (index = 0; index < SUNXI_TEST_FLASH_ERASE; index++) {
+      if ((index >= SUNXI_TEST_FLASH_OFFSET) && (index < SUNXI_TEST_FLASH_OFFSET + SUNXI_TEST_FLASH_LEN)) {
+        if (check[index] != data[index - SUNXI_TEST_FLASH_OFFSET]) errors++;
+      } else if (check[index] != 0xFF) {
+        errors++;
+      }
+    }
+
+    /* Quad read selected again, the quad enable bit being already set */
+    if ((sunxi_spi_flash_open(&flash, 0, 0) != 0) || (flash.read_cmd != SUNXI_SPI_FLASH_CMD_QUAD_READ)) errors++;
+
+    /* Protected flash, erase and write reported as failed */
+    sunxi_sim_spi_flash_set_protect(1);
+    if (sunxi_spi_flash_erase(&flash, SUNXI_TEST_FLASH_ADDR, SUNXI_TEST_FLASH_ERASE) != EROFS) errors++;
+    if (sunxi_spi_flash_write(&flash, SUNXI_TEST_FLASH_ADDR, data, SUNXI_TEST_FLASH_LEN) != EROFS) errors++;
+    sunxi_sim_spi_flash_set_protect(0);
+    if ((sunxi_spi_flash_read(&flash, SUNXI_TEST_FLASH_ADDR + SUNXI_TEST_FLASH_OFFSET, check, SUNXI_TEST_FLASH_LEN) != 0) ||
+        (memcmp(check, data, SUNXI_TEST_FLASH_LEN) != 0)) errors++;
+  }
+  sunxi_spi_set_ioctl(sunxi_sim_spi_ioctl);
+
+  return errors;
+}
+
+/**
+ * Check PWM compile, prescaler giving the most cycles per period and period error reported, and
+ * configurations not compiled refused by apply
+ * @return Number of errors
+ */
+static unsigned int sunxi_test_pwm_compile() {
+
+  static const struct sunxi_test_pwm_period periods[] = {
+    /* 20 ms servo period, 5 us per cycle */
+    { 20000000, 0, 4000, 0 },
+    /* 1 ms */
+    { 1000000, 0, 200, 0 },
+    /* 10 us, two cycles only */
+    { 10000, 0, 2, 0 },
+    /* 52.5 us, half way between two cycle counts, rounded to the nearest */
+    { 52500, 0, 11, 2500 },
+    /* 1 s, beyond 65536 cycles of the smallest prescalers */
+    { 1000000000, 4, 50000, 0 },
+  };
+  struct sunxi_pwm_config config;
+  unsigned int index, errors = 0;
+
+  for (index = 0; index < sizeof(periods) / sizeof(periods[0]); index++) {
+    if (sunxi_pwm_compile(SUNXI_PWM_CH0, periods[index].period_ns, &config) != 0) {
+      errors++;
+      continue;
+    }
+    if ((config.prescaler != periods[index].prescaler) || (config.cycles != periods[index].cycles) ||
+        (config.error_ns != periods[index].error_ns)) errors++;
+  }
+
+  /* Period too short for the fastest prescaler */
+  if (sunxi_pwm_compile(SUNXI_PWM_CH0, 1000, &config) != -EINVAL) errors++;
+
+  /* Configurations not compiled, refused before any register store */
+  memset(&config, 0, sizeof(config));
+  if (sunxi_pwm_apply(&config, 0) != -EINVAL) errors++;
+  config.ch = SUNXI_PWM_CH1 + 1;
+  config.cycles = 200;
+  if (sunxi_pwm_apply(&config, 0) != -EINVAL) errors++;
+
+  return errors;
+}
+
+/**
+ * Update SPI display and check the windows and bytes sent
+ * @param display SPI display
+ * @param windows Expected number of windows
+ * @param bytes Expected number of bytes
+ * @return Number of errors
+ */
+static unsigned int sunxi_test_spi_display_update(struct sunxi_spi_display *display, unsigned long long windows, unsigned long long bytes) {
+
+  display->windows = 0;
+  display->bytes = 0;
+  if (sunxi_spi_display_update(display) != 0) {
+    return 1;
+  }
+
+  return ((display->windows != windows) ? 1 : 0) + ((display->bytes != bytes) ? 1 : 0);
+}
+
+/**
+ * Check SPI display updates on the loopback simulator, only the changed rows being sent as windows
+ * merged across consecutive rows, the whole frame being sent after init and invalidate
+ * @return Number of errors
+ */
+static unsigned int sunxi_test_spi_display() {
+
+  static unsigned char rgb[SUNXI_TEST_DISPLAY_WIDTH * SUNXI_TEST_DISPLAY_HEIGHT * 3];
+  struct sunxi_spi_display display;
+  unsigned int index, errors = 0;
+
+  if (sunxi_spi_display_init(&display, 0, SUNXI_TEST_DISPLAY_DC_PIN, SUNXI_TEST_DISPLAY_WIDTH, SUNXI_TEST_DISPLAY_HEIGHT, 0) != 0) {
+    return 1;
+  }
+
+  /* First update, whole frame */
+  errors += sunxi_test_spi_display_update(&display, 1, SUNXI_TEST_DISPLAY_WINDOW(SUNXI_TEST_DISPLAY_WIDTH, SUNXI_TEST_DISPLAY_HEIGHT));
+
+  /* Nothing changed */
+  errors += sunxi_test_spi_display_update(&display, 0, 0);
+
+  /* Areas on disjoint rows, one window each */
+  memset(rgb, 0xFF, sizeof(rgb));
+  sunxi_spi_display_draw_rgb888(&display, 10, 10, 16, 16, rgb, 16 * 3);
+  sunxi_spi_display_draw_rgb888(&display, 100, 100, 16, 16, rgb, 16 * 3);
+  errors += sunxi_test_spi_display_update(&display, 2, 2 * SUNXI_TEST_DISPLAY_WINDOW(16, 16));
+
+  /* Diagonal, sparse rows with disjoint columns, one window per row */
+  for (index = 0; index < 100; index++) {
+    sunxi_spi_display_draw_rgb888(&display, 120 + index, 120 + index, 1, 1, rgb, 3);
+  }
+  errors += sunxi_test_spi_display_update(&display, 100, 100 * SUNXI_TEST_DISPLAY_WINDOW(1, 1));
+
+  /* Whole frame changed, one full width window */
+  memset(rgb, 0x40, sizeof(rgb));
+  sunxi_spi_display_draw_rgb888(&display, 0, 0, SUNXI_TEST_DISPLAY_WIDTH, SUNXI_TEST_DISPLAY_HEIGHT, rgb, SUNXI_TEST_DISPLAY_WIDTH * 3);
+  errors += sunxi_test_spi_display_update(&display, 1, SUNXI_TEST_DISPLAY_WINDOW(SUNXI_TEST_DISPLAY_WIDTH, SUNXI_TEST_DISPLAY_HEIGHT));
+
+  /* Invalidated, whole frame sent again although unchanged */
+  sunxi_spi_display_invalidate(&display);
+  errors += sunxi_test_spi_display_update(&display, 1, SUNXI_TEST_DISPLAY_WINDOW(SUNXI_TEST_DISPLAY_WIDTH, SUNXI_TEST_DISPLAY_HEIGHT));
+  sunxi_spi_display_deinit(&display);
+
+  return errors;
+}
+
+/**
+ * Check LRADC key events, a press held then released on CH0 giving key down, already hold events
+ * and key up with the ADC value, no event being lost
+ * @return Number of errors
+ */
+static unsigned int sunxi_test_lradc_events() {
+
+  struct sunxi_lradc_event event;
+  unsigned int holds = 0, errors = 0;
+  int r;
+
+  sunxi_sim_lradc_set_input(SUNXI_LRADC_CH0, SUNXI_TEST_LRADC_RELEASED);
+  sunxi_lradc_set_channel(SUNXI_LRADC_CH0);
+  sunxi_lradc_set_sample_rate(SUNXI_LRADC_SAMPLE_RATE_250HZ);
+  sunxi_lradc_enable();
+  if (sunxi_lradc_event_open(NULL, SUNXI_TEST_LRADC_PERIOD) < 0) {
+    sunxi_lradc_disable();
+    return 1;
+  }
+
+  /* Press, key down first */
+  usleep(20000);
+  sunxi_sim_lradc_set_input(SUNXI_LRADC_CH0, SUNXI_TEST_LRADC_KEY);
+  if ((sunxi_lradc_event_wait(&event, 100) != 0) || (event.type != SUNXI_LRADC_EVENT_KEYDOWN) ||
+      (event.ch != SUNXI_LRADC_CH0) || (event.val != SUNXI_TEST_LRADC_KEY) || (event.lost != 0)) errors++;
+
+  /* Hold, then release, already hold events until key up */
+  usleep(40000);
+  sunxi_sim_lradc_set_input(SUNXI_LRADC_CH0, SUNXI_TEST_LRADC_RELEASED);
+  while ((r = sunxi_lradc_event_wait(&event, 100)) == 0) {
+    if ((event.ch != SUNXI_LRADC_CH0) || (event.lost != 0)) errors++;
+    if (event.type != SUNXI_LRADC_EVENT_ALREADY_HOLD) break;
+    if (event.val != SUNXI_TEST_LRADC_KEY) errors++;
+    holds++;
+  }
+  if ((r != 0) || (holds == 0) || (event.type != SUNXI_LRADC_EVENT_KEYUP) || (event.val != SUNXI_TEST_LRADC_RELEASED)) errors++;
+
+  /* Nothing after key up */
+  if (sunxi_lradc_event_wait(&event, 20) != -ETIMEDOUT) errors++;
+  sunxi_lradc_event_close();
+  sunxi_lradc_disable();
+
+  return errors;
+}
+
+/**
+ * Drain LRADC consumer once the acquisition is stopped
+ * @param consumer Consumer
+ * @param last Timestamp of the last sample read, unchanged if no sample is pending
+ * @param lost Number of samples reported as lost
+ * @return Number of samples read
+ */
+static unsigned int sunxi_test_lradc_drain(struct sunxi_lradc_consumer *consumer, struct timespec *last, unsigned long long *lost) {
+
+  struct sunxi_lradc_sample sample;
+  unsigned int count = 0;
+
+  while (sunxi_lradc_consumer_read(consumer, &sample) == 0) {
+    *last = sample.timestamp;
+    *lost += sample.lost;
+    count++;
+  }
+
+  return count;
+}
+
+/**
+ * Check LRADC acquisition consumers, two consumers keeping up reading every sample exactly once,
+ * and a consumer falling more than SUNXI_LRADC_RING_SIZE behind reporting the overwritten samples
+ * @return Number of errors
+ */
+static unsigned int sunxi_test_lradc_consumers() {
+
+  struct sunxi_lradc_consumer consumers[3];
+  struct sunxi_lradc_sample samples[2];
+  struct timespec prev = { 0, 0 }, last[3];
+  unsigned long long lost[3] = { 0, 0, 0 };
+  unsigned int index, count[2], lagging, errors = 0;
+
+  sunxi_sim_lradc_set_input(SUNXI_LRADC_CH0, SUNXI_TEST_LRADC_RELEASED);
+  sunxi_lradc_set_channel(SUNXI_LRADC_CH0);
+  sunxi_lradc_set_sample_rate(SUNXI_LRADC_SAMPLE_RATE_250HZ);
+  for (index = 0; index < 3; index++) {
+    if (sunxi_lradc_consumer_open(&consumers[index]) < 0) {
+      while (index-- > 0) sunxi_lradc_consumer_close(&consumers[index]);
+      return 1;
+    }
+  }
+  sunxi_lradc_enable();
+  if (sunxi_lradc_acquire_start(NULL, SUNXI_TEST_LRADC_PERIOD) != 0) {
+    errors++;
+    goto close;
+  }
+
+  /* Consumers keeping up, same samples in order and none lost */
+  for (count[0] = 0; count[0] < SUNXI_TEST_LRADC_SAMPLES; count[0]++) {
+    if ((sunxi_lradc_consumer_wait(&consumers[0], &samples[0], 100) != 0) ||
+        (sunxi_lradc_consumer_wait(&consumers[1], &samples[1], 100) != 0)) {
+      errors++;
+      break;
+    }
+    if ((samples[0].lost != 0) || (samples[1].lost != 0) ||
+        (samples[0].timestamp.tv_sec != samples[1].timestamp.tv_sec) || (samples[0].timestamp.tv_nsec != samples[1].timestamp.tv_nsec) ||
+        (samples[0].channels != 1) || (samples[0].val[0] != SUNXI_TEST_LRADC_RELEASED)) errors++;
+    if ((samples[0].timestamp.tv_sec < prev.tv_sec) ||
+        ((samples[0].timestamp.tv_sec == prev.tv_sec) && (samples[0].timestamp.tv_nsec <= prev.tv_nsec))) errors++;
+    prev = samples[0].timestamp;
+  }
+  sunxi_lradc_acquire_stop();
+
+  /* Remaining samples, the lagging consumer reading the last ones of the ring only */
+  last[0] = last[1] = last[2] = prev;
+  count[1] = count[0] + sunxi_test_lradc_drain(&consumers[1], &last[1], &lost[1]);
+  count[0] += sunxi_test_lradc_drain(&consumers[0], &last[0], &lost[0]);
+  lagging = sunxi_test_lradc_drain(&consumers[2], &last[2], &lost[2]);
+  if (count[1] != count[0]) errors++;
+  if ((lost[0] != 0) || (lost[1] != 0) || (consumers[0].overflows != 0) || (consumers[1].overflows != 0)) errors++;
+  if ((lagging != SUNXI_LRADC_RING_SIZE) || (lagging + lost[2] != count[0]) || (consumers[2].overflows != lost[2])) errors++;
+  for (index = 1; index < 3; index++) {
+    if ((last[index].tv_sec != last[0].tv_sec) || (last[index].tv_nsec != last[0].tv_nsec)) errors++;
+  }
+
+close:
+  for (index = 0; index < 3; index++) {
+    sunxi_lradc_consumer_close(&consumers[index]);
+  }
+  sunxi_lradc_disable();
+
+  return errors;
+}
+
+/**
+ * Report check result
+ * @param name Check name
+ * @param errors Number of errors, 0 if the check succeeded
+ * @return 1 if the check failed, 0 otherwise
+ */
+static int sunxi_test_report(char *name, unsigned int errors) {
+
+  if (errors != 0) {
+    printf("%-28s FAILED (%u)\n", name, errors);
+    return 1;
+  }
+  printf("%-28s ok\n", name);
+  return 0;
+}
+
+
+/****************************************************************************************/
+/* Main                                                                                 */
+/****************************************************************************************/
+
+int main() {
+
+  int r, failed = 0;
+
+  /* Initialize interfaces on the simulator */
+  if ((r = sunxi_sim_init(1000)) < 0) {
+    fprintf(stderr, "Unable to initialize simulator (%d)\n", r);
+    return 1;
+  }
+  if ((r = sunxi_hw_init(SUNXI_HW_ALL)) < 0) {
+    fprintf(stderr, "Unable to initialize interfaces (%d)\n", r);
+    return 1;
+  }
+
+  /* Lock checks, no update may be lost */
+  failed += sunxi_test_report("lock_thread_lost_updates", sunxi_test_lock_thread());
+  failed += sunxi_test_report("lock_process_lost_updates", sunxi_test_lock_process());
+
+  /* GPIO checks */
+  failed += sunxi_test_report("gpio_eint_events", sunxi_test_gpio_events());
+
+  /* PWM checks */
+  failed += sunxi_test_report("pwm_compile_periods", sunxi_test_pwm_compile());
+
+  /* LRADC checks */
+  failed += sunxi_test_report("lradc_key_events", sunxi_test_lradc_events());
+  failed += sunxi_test_report("lradc_consumers", sunxi_test_lradc_consumers());
+
+  /* SPI flash checks */
+  failed += sunxi_test_report("spi_flash_write_read_back", sunxi_test_spi_flash());
+
+  /* SPI display checks */
+  failed += sunxi_test_report("spi_display_update_windows", sunxi_test_spi_display());
+
+  /* Release interfaces */
+  sunxi_hw_deinit();
+  sunxi_sim_deinit();
+
+  return (failed != 0) ? 1 : 0;
+}